@@ -1,293 +1,2913 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <pthread.h>
-#include <semaphore.h>
-#include <time.h>
-#include <unistd.h>
-
-// Estrutura para armazenar cada reserva (PNR)
-typedef struct PNRNode {
-    int pnr;
-    time_t timestamp;         // Horário da reserva
-    int pago;                 //0 se nao pago, 1 se pago
-    struct PNRNode *next;
-} PNRNode;
-
-PNRNode *meuPNR = NULL;         // Lista encadeada de reservas
-
-// Mutex para proteger o acesso à lista de reservas
-pthread_mutex_t meuPNR_mutex;
-
-// Semáforos para controle das operações
-sem_t sem_reserva, sem_consulta, sem_pagamento, sem_cancelamento;
-
-// Função auxiliar para gerar um PNR aleatório (entre 1000 e 9999)
-int gerarPNR() {
-    return 1000 + rand() % 9000;
-}
-
-// Função que insere uma nova reserva na lista
-void adicionarReserva() {
-    PNRNode *novoNo = (PNRNode*)malloc(sizeof(PNRNode));
-    if (!novoNo) {
-        perror("Erro ao alocar memória");
+#include "projeto.h"
+#include "indice.h"
+#include "executor.h"
+#include "cdc.h"
+#include "dedup.h"
+#include "servidor.h"
+#include "escalonador.h"
+
+ArmazemPNR *meuPNR[MAX_PARTICOES]; // Lista encadeada de reservas de cada partição (local ou partilhada)
+int n_particoes = PARTICOES_POR_OMISSAO;
+const char *nome_shm = NULL;    // definido por --shm
+const char *nome_cdc = NULL;    // definido por --cdc ou, com --shm, pelo segmento
+char cdc_do_armazem[MAX_NOME_CDC];
+size_t tamanho_armazem = 0;
+
+uint32_t codificarPNR(const char *texto) {
+    uint32_t codigo = 0;
+    int n = 0;
+    for (; texto[n]; n++) {
+        char c = texto[n];
+        int d;
+        if (c >= '0' && c <= '9')
+            d = c - '0';
+        else if (c >= 'A' && c <= 'Z')
+            d = c - 'A' + 10;
+        else if (c >= 'a' && c <= 'z')
+            d = c - 'a' + 10;
+        else
+            return PNR_INVALIDO;
+        if (n == DIGITOS_PNR)
+            return PNR_INVALIDO;
+        codigo = codigo * 36 + d;
+    }
+    return n > 0 ? codigo : PNR_INVALIDO;
+}
+
+void descodificarPNR(uint32_t codigo, char *texto) {
+    static const char DIGITOS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    for (int k = DIGITOS_PNR - 1; k >= 0; k--) {
+        texto[k] = DIGITOS[codigo % 36];
+        codigo /= 36;
+    }
+    texto[DIGITOS_PNR] = '\0';
+}
+
+#define TABELA_PNR(a) (DENSOS(a) + (a)->capacidade)
+
+#define BITS_TABELA_PNR 17                       // 2 * CAPACIDADE_PNR posições: ocupação <= 1/2
+#define POSICOES_TABELA_PNR (1 << BITS_TABELA_PNR)
+_Static_assert(POSICOES_TABELA_PNR >= 2 * CAPACIDADE_PNR, "tabela de PNRs demasiado pequena");
+
+static inline uint32_t posicaoTabelaPNR(uint32_t pnr) {
+    return (pnr * 0x9e3779b1u) >> (32 - BITS_TABELA_PNR);
+}
+
+// Acrescenta o nó i (ainda sem entrada) à tabela de PNRs
+static inline void tabelaInserir(ArmazemPNR *a, int32_t i) {
+    int32_t *t = TABELA_PNR(a);
+    uint32_t k = posicaoTabelaPNR(NO(a, i)->pnr);
+    while (t[k] != NENHUM)
+        k = (k + 1) & (POSICOES_TABELA_PNR - 1);
+    t[k] = i;
+}
+
+// Retira o nó i da tabela. Sem lápides: as entradas seguintes da mesma
+// sequência recuam para a posição libertada, se a sua posição ideal o permitir.
+static inline void tabelaRemover(ArmazemPNR *a, int32_t i) {
+    int32_t *t = TABELA_PNR(a);
+    uint32_t livre = posicaoTabelaPNR(NO(a, i)->pnr);
+    while (t[livre] != i)
+        livre = (livre + 1) & (POSICOES_TABELA_PNR - 1);
+    for (uint32_t j = livre;;) {
+        j = (j + 1) & (POSICOES_TABELA_PNR - 1);
+        if (t[j] == NENHUM)
+            break;
+        uint32_t ideal = posicaoTabelaPNR(NO(a, t[j])->pnr);
+        // Fica se a posição ideal estiver em ]livre, j] (circularmente)
+        if (livre <= j ? (livre < ideal && ideal <= j) : (livre < ideal || ideal <= j))
+            continue;
+        t[livre] = t[j];
+        livre = j;
+    }
+    t[livre] = NENHUM;
+}
+
+// Reconstrói a tabela a partir do vetor denso
+static inline void tabelaReconstruir(ArmazemPNR *a) {
+    int n = atomic_load_explicit(&a->n_reservas, memory_order_relaxed);
+    for (int32_t k = 0; k < POSICOES_TABELA_PNR; k++)
+        TABELA_PNR(a)[k] = NENHUM;
+    for (int k = 0; k < n; k++)
+        tabelaInserir(a, DENSOS(a)[k]);
+}
+
+// ===================== Colocação em CPUs e nós NUMA =====================
+// Cada partição pertence a um nó NUMA: a sua memória é tocada pela primeira
+// vez (e portanto alocada) por uma thread fixada nos CPUs desse nó, e as
+// operações sobre ela correm nesses CPUs, salvo se --cpus-operacoes indicar
+// outra coisa. As threads de expiração e de impressão podem ser fixadas à parte.
+
+#define MAX_NOS_NUMA 16
+#define MAX_CPUS_RELATORIO 256
+
+cpu_set_t cpus_no[MAX_NOS_NUMA];  // CPUs de cada nó NUMA
+int n_nos_numa = 0;
+int no_da_particao[MAX_PARTICOES];
+
+cpu_set_t cpus_operacoes, cpus_expiracao, cpus_impressao; // --cpus-* (vazio = sem fixação explícita)
+
+// Quantas vezes cada CPU bloqueou cada partição (para o relatório)
+atomic_ulong servido_por_cpu[MAX_PARTICOES][MAX_CPUS_RELATORIO];
+
+// Tempo máximo (segundos) que a drenagem espera pelas operações em curso
+#define PRAZO_DRENAGEM 10
+
+// Estado do motor de reservas: em drenagem deixam de ser admitidas novas
+// operações, as que estão em curso terminam e o processo sai de forma ordenada.
+enum { MOTOR_ATIVO = 0, MOTOR_DRENANDO, MOTOR_PARADO };
+atomic_int estado_motor = MOTOR_ATIVO;
+atomic_int operacoes_em_curso = 0;
+
+// Acorda as threads de fundo (timeout e impressão) e o main durante a drenagem
+pthread_mutex_t drenagem_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t drenagem_cond = PTHREAD_COND_INITIALIZER;
+
+// Lê uma lista de CPUs no formato do kernel ("0-3,8,10-11"). Retorna 0 se for válida.
+int lerListaCPUs(const char *texto, cpu_set_t *conjunto) {
+    CPU_ZERO(conjunto);
+    while (*texto && *texto != '\n') {
+        char *fim;
+        long inicio = strtol(texto, &fim, 10), ultimo;
+        if (fim == texto)
+            return -1;
+        ultimo = inicio;
+        if (*fim == '-')
+            ultimo = strtol(fim + 1, &fim, 10);
+        for (long c = inicio; c <= ultimo && c < CPU_SETSIZE; c++)
+            CPU_SET(c, conjunto);
+        texto = (*fim == ',') ? fim + 1 : fim;
+    }
+    return CPU_COUNT(conjunto) > 0 ? 0 : -1;
+}
+
+// Descobre os nós NUMA em /sys. Sem essa informação, há um único nó com os
+// CPUs a que o processo tem acesso.
+void descobrirTopologia() {
+    for (n_nos_numa = 0; n_nos_numa < MAX_NOS_NUMA; n_nos_numa++) {
+        char caminho[64], linha[1024];
+        snprintf(caminho, sizeof(caminho), "/sys/devices/system/node/node%d/cpulist", n_nos_numa);
+        FILE *f = fopen(caminho, "r");
+        if (!f)
+            break;
+        int ok = fgets(linha, sizeof(linha), f) && lerListaCPUs(linha, &cpus_no[n_nos_numa]) == 0;
+        fclose(f);
+        if (!ok)
+            break;
+    }
+    if (n_nos_numa == 0) {
+        sched_getaffinity(0, sizeof(cpu_set_t), &cpus_no[0]);
+        n_nos_numa = 1;
+    }
+    for (int p = 0; p < n_particoes; p++)
+        no_da_particao[p] = p % n_nos_numa;
+}
+
+// Prepara atributos de criação de thread fixados ao conjunto de CPUs indicado
+// (sem fixação se o conjunto estiver vazio).
+void atributosFixados(pthread_attr_t *attr, const cpu_set_t *cpus) {
+    pthread_attr_init(attr);
+    if (CPU_COUNT(cpus) > 0)
+        pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), cpus);
+}
+
+// Atributos para uma operação sobre a partição p: CPUs de --cpus-operacoes
+// ou, por omissão, os CPUs do nó NUMA dono da partição.
+void atributosOperacao(pthread_attr_t *attr, int p) {
+    atributosFixados(attr, CPU_COUNT(&cpus_operacoes) > 0 ? &cpus_operacoes : &cpus_no[no_da_particao[p]]);
+}
+
+int particaoDoPNR(uint32_t pnr) {
+    return (int)(pnr % (uint32_t)n_particoes);
+}
+
+// ===================== Geradores aleatórios por thread =====================
+// xoshiro256** (aleatorio.h) com estado por thread. Cada thread recebe, no
+// primeiro uso, o seu próprio fluxo: o gerador base avança 2^128 passos por
+// cada thread. Com --semente N a sequência do main é reproduzível e cada
+// thread obtém o fluxo pela ordem do seu primeiro uso.
+Aleatorio gerador_base;
+pthread_mutex_t gerador_mutex = PTHREAD_MUTEX_INITIALIZER;
+__thread Aleatorio gerador;
+__thread int gerador_pronto = 0;
+
+void semearGeradores(uint64_t semente) {
+    semearAleatorio(&gerador_base, semente);
+}
+
+// Gerador da thread atual (cria o fluxo da thread no primeiro uso)
+Aleatorio* geradorThread() {
+    if (!gerador_pronto) {
+        pthread_mutex_lock(&gerador_mutex);
+        gerador = gerador_base;
+        saltarAleatorio(&gerador_base);
+        pthread_mutex_unlock(&gerador_mutex);
+        gerador_pronto = 1;
+    }
+    return &gerador;
+}
+
+// Inteiro aleatório uniforme em [0, n), do gerador da thread
+uint32_t aleatorio(uint32_t n) {
+    return aleatorioEm(geradorThread(), n);
+}
+
+#define PRIMEIRO_PNR 60466176u           // 36^5 = "100000"
+#define N_PNRS (LIMITE_PNR - PRIMEIRO_PNR) // PNRs de "100000" a "ZZZZZZ"
+
+// Função auxiliar para gerar um PNR aleatório da partição p, sempre com 6
+// caracteres (nunca começa por '0', e por isso nunca é 0, que no protocolo
+// quer dizer "um PNR novo"): sorteia diretamente entre os PNRs x com
+// x % n_particoes == p
+uint32_t gerarPNR(int p) {
+    uint32_t n = (uint32_t)n_particoes;
+    uint32_t primeiro = ((uint32_t)p + n - PRIMEIRO_PNR % n) % n;
+    uint32_t quantos = (N_PNRS - 1 - primeiro) / n + 1;
+    return PRIMEIRO_PNR + primeiro + n * aleatorio(quantos);
+}
+
+// ===================== Relógio =====================
+// Todas as horas do motor (instante das reservas, prazos e expiração, pausas
+// das threads de fundo e do ciclo de operações) vêm daqui. Em tempo real é o
+// relógio do sistema. Com --simular HORAS o relógio é virtual, por eventos
+// discretos: só avança quando todas as threads participantes estão a dormir
+// nele e salta logo para o primeiro despertar. Os prazos e a expiração são
+// os mesmos, só que sem esperar por eles. Por isso uma pausa em tempo virtual
+// dura pelo menos PAUSA_MINIMA_VIRTUAL_MS: uma pausa de 0 ms voltaria logo,
+// sem nunca deixar o relógio avançar. Cada thread dorme na sua própria
+// variável de condição: ao avançar só acordam as que chegaram ao prazo, o que
+// conta quando há milhares de clientes na lista de espera.
+#define PAUSA_MINIMA_VIRTUAL_MS 1
+typedef struct Despertar {
+    int64_t prazo_ms;
+    void *ctx;                     // contexto de continuar (relogioAcordarContexto)
+    pthread_cond_t cond;
+    struct Despertar *prox;
+} Despertar;
+
+int relogio_virtual = 0;
+atomic_llong relogio_ms = 0;       // tempo virtual (ms desde 1970)
+pthread_mutex_t relogio_mutex = PTHREAD_MUTEX_INITIALIZER;
+int relogio_participantes = 0;     // threads cujas pausas contam
+int relogio_dormentes = 0;
+Despertar *despertares = NULL;
+
+int64_t relogioAgoraMs() {
+    if (relogio_virtual)
+        return atomic_load(&relogio_ms);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+time_t relogioAgora() {
+    return relogioAgoraMs() / 1000;
+}
+
+// Passa o relógio para virtual, a começar em inicio_ms (0: na hora atual)
+void relogioVirtual(int64_t inicio_ms) {
+    atomic_store(&relogio_ms, inicio_ms ? inicio_ms : relogioAgoraMs());
+    relogio_virtual = 1;
+}
+
+// Com relogio_mutex: se todos os participantes dormem, salta para o primeiro despertar
+static void relogioAvancar() {
+    if (relogio_dormentes < relogio_participantes || despertares == NULL)
+        return;
+    int64_t primeiro = INT64_MAX;
+    for (Despertar *d = despertares; d; d = d->prox) {
+        if (d->prazo_ms < primeiro)
+            primeiro = d->prazo_ms;
+    }
+    if (primeiro > atomic_load(&relogio_ms))
+        atomic_store(&relogio_ms, primeiro);
+    for (Despertar *d = despertares; d; d = d->prox) {
+        if (d->prazo_ms <= primeiro)
+            pthread_cond_signal(&d->cond);
+    }
+}
+
+// Regista mais uma thread participante (chamada antes de a criar)
+void relogioParticipar() {
+    if (!relogio_virtual)
+        return;
+    pthread_mutex_lock(&relogio_mutex);
+    relogio_participantes++;
+    pthread_mutex_unlock(&relogio_mutex);
+}
+
+// Chamada pela thread participante quando termina
+void relogioSair() {
+    if (!relogio_virtual)
+        return;
+    pthread_mutex_lock(&relogio_mutex);
+    relogio_participantes--;
+    relogioAvancar();
+    pthread_mutex_unlock(&relogio_mutex);
+}
+
+// Relógio virtual: dorme até prazo_ms ou até continuar(ctx) dar 0 (verificado
+// de novo a cada relogioAcordar)
+void relogioDormirAte(int64_t prazo_ms, int (*continuar)(void*), void *ctx) {
+    Despertar eu = { .prazo_ms = prazo_ms, .ctx = ctx };
+    pthread_cond_init(&eu.cond, NULL);
+    pthread_mutex_lock(&relogio_mutex);
+    eu.prox = despertares;
+    despertares = &eu;
+    relogio_dormentes++;
+    relogioAvancar();
+    while (atomic_load(&relogio_ms) < prazo_ms && (!continuar || continuar(ctx)))
+        pthread_cond_wait(&eu.cond, &relogio_mutex);
+    Despertar **d = &despertares;
+    while (*d != &eu)
+        d = &(*d)->prox;
+    *d = eu.prox;
+    relogio_dormentes--;
+    pthread_mutex_unlock(&relogio_mutex);
+    pthread_cond_destroy(&eu.cond);
+}
+
+// Acorda quem dorme no relógio virtual para reavaliar continuar()
+void relogioAcordar() {
+    pthread_mutex_lock(&relogio_mutex);
+    for (Despertar *d = despertares; d; d = d->prox)
+        pthread_cond_signal(&d->cond);
+    pthread_mutex_unlock(&relogio_mutex);
+}
+
+// Acorda só quem dorme com o contexto ctx
+void relogioAcordarContexto(void *ctx) {
+    pthread_mutex_lock(&relogio_mutex);
+    for (Despertar *d = despertares; d; d = d->prox) {
+        if (d->ctx == ctx)
+            pthread_cond_signal(&d->cond);
+    }
+    pthread_mutex_unlock(&relogio_mutex);
+}
+
+void relogioDormir(int64_t ms) {
+    if (relogio_virtual)
+        relogioDormirAte(relogioAgoraMs() + (ms > PAUSA_MINIMA_VIRTUAL_MS ? ms : PAUSA_MINIMA_VIRTUAL_MS), NULL, NULL);
+    else
+        usleep(ms * 1000);
+}
+
+// ===================== Trincos das partições =====================
+// Em memória local cada partição usa um trinco híbrido (trinco.h): giro
+// adaptativo e futex, ou fila MCS com --trinco-justo. kill -USR1 ao processo
+// imprime o perfil de contenção.
+Trinco trincos_particao[MAX_PARTICOES];
+__thread NoMCS nos_particao[MAX_PARTICOES]; // nó MCS de cada thread em cada partição
+
+int64_t agoraNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void iniciarTrincos() {
+    for (int p = 0; p < MAX_PARTICOES; p++)
+        atomic_store(&trincos_particao[p].giro, GIRO_INICIAL);
+}
+
+void imprimirPerfilTrincos() {
+    printf("[Trincos] modo %s\n", nome_shm ? "mutex robusto partilhado (--shm)"
+                                   : trincos_justos ? "justo (fila MCS)" : "giro adaptativo + futex");
+    for (int p = 0; p < MAX_PARTICOES; p++) {
+        char nome[32];
+        if (atomic_load_explicit(&trincos_particao[p].aquisicoes, memory_order_relaxed) == 0)
+            continue;
+        snprintf(nome, sizeof(nome), "partição %d", p);
+        imprimirPerfilTrinco(nome, &trincos_particao[p]);
+    }
+}
+
+// Imprime o perfil se um SIGUSR1 o pediu (chamado pelos ciclos principais)
+void atenderPedidoPerfil() {
+    if (trincoPerfilPedido())
+        imprimirPerfilTrincos();
+}
+
+// ===================== Abertura do armazenamento =====================
+// Cada partição é criada (ou, no modo --shm, ligada) a partir do seu nó NUMA;
+// o índice por prazo (indice.h) abre e fecha com o armazenamento.
+
+// O CDC é uma propriedade do segmento --shm: quem o cria regista o nome do
+// seu --cdc (ou nenhum) e quem se liga publica no mesmo segmento, porque os
+// eventos das reservas feitas por um processo que não publicasse faltariam ao
+// fluxo. Sem --cdc adota o do segmento; com um --cdc diferente recusa ligar-se.
+int conferirCDC(ArmazemPNR *a, int p) {
+    if (!nome_cdc && a->cdc[0]) {
+        snprintf(cdc_do_armazem, sizeof(cdc_do_armazem), "%s", a->cdc);
+        nome_cdc = cdc_do_armazem;
+        printf("[CDC] O segmento %s publica em %s: este processo também.\n", nome_shm, nome_cdc);
+    }
+    if (strcmp(nome_cdc ? nome_cdc : "", a->cdc) != 0) {
+        fprintf(stderr, "A partição %s.%d publica %s%s e este processo %s%s\n", nome_shm, p,
+                a->cdc[0] ? "em " : "sem CDC", a->cdc, nome_cdc ? "em " : "sem CDC", nome_cdc ? nome_cdc : "");
+        return -1;
+    }
+    return 0;
+}
+
+// Cria (ou, no modo --shm, cria ou liga-se a) a partição p. Corre numa thread
+// fixada ao nó NUMA da partição, para que as páginas fiquem nesse nó.
+void* abrirParticao(void* arg) {
+    int p = (intptr_t)arg;
+    int criador = 1;
+    ArmazemPNR *a;
+
+    if (nome_shm == NULL) {
+        a = mmap(NULL, tamanho_armazem, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (a == MAP_FAILED) {
+            perror("Erro ao alocar memória");
+            return (void*)-1;
+        }
+    } else {
+        char nome[256];
+        snprintf(nome, sizeof(nome), "%s.%d", nome_shm, p);
+        int fd = shm_open(nome, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd == -1 && errno == EEXIST) {
+            criador = 0; // outro processo já criou o segmento
+            fd = shm_open(nome, O_RDWR, 0600);
+        }
+        if (fd == -1 || (criador && ftruncate(fd, tamanho_armazem) == -1)) {
+            perror("Erro ao abrir a memória partilhada");
+            return (void*)-1;
+        }
+        a = mmap(NULL, tamanho_armazem, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (a == MAP_FAILED) {
+            perror("Erro ao mapear a memória partilhada");
+            return (void*)-1;
+        }
+        if (!criador) {
+            while (atomic_load(&a->magia) != MAGIA_ARMAZEM)
+                usleep(1000); // espera que o criador acabe de inicializar
+            if (conferirCDC(a, p) != 0) {
+                munmap(a, tamanho_armazem);
+                return (void*)-1;
+            }
+            meuPNR[p] = a;
+            return NULL;
+        }
+    }
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    if (nome_shm) {
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    }
+    pthread_mutex_init(&a->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    // Este ciclo é o primeiro toque em todas as páginas da partição
+    a->capacidade = CAPACIDADE_PNR;
+    atomic_init(&a->n_reservas, 0);
+    for (int32_t i = 0; i < CAPACIDADE_PNR; i++) {
+        a->nos[i].ligacao = LIGACAO_LIVRE((i + 1 < CAPACIDADE_PNR) ? i + 1 : NENHUM);
+        DENSOS(a)[i] = NENHUM;
+    }
+    for (int32_t k = 0; k < POSICOES_TABELA_PNR; k++)
+        TABELA_PNR(a)[k] = NENHUM;
+    a->livre = 0;
+    snprintf(a->cdc, sizeof(a->cdc), "%s", nome_cdc ? nome_cdc : "");
+    atomic_store(&a->magia, MAGIA_ARMAZEM);
+    meuPNR[p] = a;
+    return NULL;
+}
+
+// Abre todas as partições, cada uma a partir do seu nó NUMA. Retorna 0 em caso de sucesso.
+int abrirArmazem() {
+    tamanho_armazem = sizeof(ArmazemPNR) + (size_t)CAPACIDADE_PNR * (sizeof(PNRNode) + sizeof(int32_t))
+                    + (size_t)POSICOES_TABELA_PNR * sizeof(int32_t);
+    descobrirTopologia();
+    abrirIndice();
+
+    for (int p = 0; p < n_particoes; p++) {
+        pthread_attr_t attr;
+        pthread_t t;
+        void *resultado;
+        atributosFixados(&attr, &cpus_no[no_da_particao[p]]);
+        pthread_create(&t, &attr, abrirParticao, (void*)(intptr_t)p);
+        pthread_attr_destroy(&attr);
+        pthread_join(t, &resultado);
+        if (resultado != NULL)
+            return -1;
+    }
+    if (nome_shm)
+        printf("[Armazém] %d partições em %s.0 .. %s.%d.\n", n_particoes, nome_shm, nome_shm, n_particoes - 1);
+    printf("[Armazém] %d partição(ões) em %d nó(s) NUMA.\n", n_particoes, n_nos_numa);
+    return 0;
+}
+
+// Liberta o armazenamento. No modo --shm apenas o desmapeia: os segmentos
+// continuam disponíveis para os outros processos (remover com rm /dev/shm/NOME.*).
+void fecharArmazem() {
+    for (int p = 0; p < n_particoes; p++) {
+        if (nome_shm == NULL)
+            pthread_mutex_destroy(&meuPNR[p]->mutex);
+        munmap(meuPNR[p], tamanho_armazem);
+        meuPNR[p] = NULL;
+    }
+    fecharIndice();
+}
+
+// ===================== Cache de consultas =====================
+// As consultas por PNR são servidas por uma cache partilhada (FATIAS_CONSULTA
+// fatias com mutex próprio, ENTRADAS_POR_FATIA entradas de mapeamento direto)
+// sem bloquear a partição. Cada entrada guarda a versão do PNR quando foi
+// lida; inserir, pagar e retirar uma reserva (cancelamento, expiração, eventos
+// da réplica) sobem a versão, e uma entrada com versão antiga é uma falha.
+// As versões estão repartidas por hash do PNR (dois PNRs podem partilhar a
+// versão, o que só causa falhas a mais). No modo --shm outros processos
+// alteram as partições sem subir as nossas versões, por isso a cache fica
+// desligada.
+#define FATIAS_CONSULTA 64
+#define ENTRADAS_POR_FATIA 64
+#define VERSOES_CONSULTA (FATIAS_CONSULTA * ENTRADAS_POR_FATIA)
+
+atomic_uint versao_consulta[VERSOES_CONSULTA];
+atomic_uint versao_global_consulta = 0; // sobe quando uma partição inteira muda
+int cache_consultas_ativa = 0;
+
+static inline uint32_t hashConsulta(uint32_t pnr) {
+    return (pnr * 0x9e3779b1u) >> 20; // 12 bits = VERSOES_CONSULTA
+}
+
+// Chamada com a partição bloqueada, depois de alterar a reserva do PNR
+static inline void invalidarConsulta(uint32_t pnr) {
+    atomic_fetch_add_explicit(&versao_consulta[hashConsulta(pnr)], 1, memory_order_release);
+}
+
+// Reconstrói o vetor denso, a lista livre, a contagem e a tabela de PNRs depois de um processo
+// ter morrido com o mutex na mão. Um nó está vivo se a ligação for uma posição
+// (>= 0); a morte a meio de uma inserção ou remoção perde no máximo essa operação.
+void repararArmazem(ArmazemPNR *a) {
+    int32_t n = 0;
+    a->livre = NENHUM;
+    for (int32_t i = a->capacidade - 1; i >= 0; i--) {
+        if (NO(a, i)->ligacao >= 0) {
+            NO(a, i)->ligacao = n;
+            DENSOS(a)[n++] = i;
+        } else {
+            NO(a, i)->ligacao = LIGACAO_LIVRE(a->livre);
+            a->livre = i;
+        }
+    }
+    atomic_store(&a->n_reservas, n);
+    tabelaReconstruir(a);
+    atomic_fetch_add(&versao_global_consulta, 1);
+    printf("[Armazém] Processo terminado a meio de uma operação: partição reparada (%d reservas).\n", n);
+}
+
+// Bloqueia a partição p e devolve-a, registando no perfil o sítio da chamada.
+// Em memória local usa o trinco híbrido da partição; no modo --shm continua o
+// mutex robusto partilhado entre processos (o trinco só guarda o perfil) e, se
+// o dono anterior morreu com ele, repara as estruturas antes de continuar.
+ArmazemPNR* bloquearPNREm(int p, const char *funcao, int linha) {
+    ArmazemPNR *a = meuPNR[p];
+    Trinco *t = &trincos_particao[p];
+    if (nome_shm) {
+        int64_t inicio_espera = 0;
+        int r = pthread_mutex_trylock(&a->mutex);
+        if (r == EBUSY) {
+            inicio_espera = agoraNs();
+            r = pthread_mutex_lock(&a->mutex);
+        }
+        if (r == EOWNERDEAD) {
+            repararArmazem(a);
+            pthread_mutex_consistent(&a->mutex);
+        }
+        trincoAdquirido(t, inicio_espera, funcao, linha);
+    } else
+        trincoBloquear(t, &nos_particao[p], funcao, linha);
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && cpu < MAX_CPUS_RELATORIO)
+        atomic_fetch_add_explicit(&servido_por_cpu[p][cpu], 1, memory_order_relaxed);
+    return a;
+}
+
+void desbloquearPNR(int p) {
+    if (nome_shm) {
+        trincoALargar(&trincos_particao[p]);
+        pthread_mutex_unlock(&meuPNR[p]->mutex);
+    } else
+        trincoDesbloquear(&trincos_particao[p], &nos_particao[p]);
+}
+
+// Relatório de colocação: nó de cada partição e CPUs que a serviram
+void imprimirColocacao() {
+    printf("=== Colocação das partições ===\n");
+    for (int p = 0; p < n_particoes; p++) {
+        printf("Partição %d (nó %d, %d reservas): CPUs", p, no_da_particao[p], meuPNR[p]->n_reservas);
+        for (int c = 0; c < MAX_CPUS_RELATORIO; c++) {
+            unsigned long n = atomic_load_explicit(&servido_por_cpu[p][c], memory_order_relaxed);
+            if (n > 0)
+                printf(" %d(%lu)", c, n);
+        }
+        printf("\n");
+    }
+}
+
+// Escolhe uma partição com probabilidade proporcional ao seu número de reservas
+// (leitura sem bloqueio: é só uma estimativa).
+int escolherParticao() {
+    int total = 0;
+    for (int p = 0; p < n_particoes; p++)
+        total += meuPNR[p]->n_reservas;
+    if (total <= 0)
+        return aleatorio(n_particoes);
+    int r = aleatorio(total);
+    for (int p = 0; p < n_particoes; p++) {
+        r -= meuPNR[p]->n_reservas;
+        if (r < 0)
+            return p;
+    }
+    return n_particoes - 1;
+}
+
+// Procura uma reserva pelo PNR (NENHUM se não existir), pela tabela de PNRs
+int32_t procurarReserva(ArmazemPNR *a, uint32_t pnr) {
+    int32_t *t = TABELA_PNR(a);
+    for (uint32_t k = posicaoTabelaPNR(pnr); t[k] != NENHUM; k = (k + 1) & (POSICOES_TABELA_PNR - 1)) {
+        if (NO(a, t[k])->pnr == pnr)
+            return t[k];
+    }
+    return NENHUM;
+}
+
+enum { ESTADO_INEXISTENTE = 0, ESTADO_POR_PAGAR, ESTADO_PAGO };
+
+typedef struct {
+    uint32_t pnr;             // PNR_INVALIDO = entrada vazia
+    int32_t estado;
+    uint32_t versao, versao_global;
+    int64_t prazo;
+} EntradaConsulta;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    EntradaConsulta entradas[ENTRADAS_POR_FATIA];
+} FatiaConsulta;
+
+FatiaConsulta fatias_consulta[FATIAS_CONSULTA];
+atomic_long consultas_acertos = 0, consultas_falhas = 0, consultas_obsoletas = 0;
+
+void abrirCacheConsultas() {
+    cache_consultas_ativa = (nome_shm == NULL);
+    for (int f = 0; f < FATIAS_CONSULTA; f++) {
+        pthread_mutex_init(&fatias_consulta[f].mutex, NULL);
+        for (int k = 0; k < ENTRADAS_POR_FATIA; k++)
+            fatias_consulta[f].entradas[k].pnr = PNR_INVALIDO;
+    }
+}
+
+// Estado do PNR (ESTADO_*) e, se existe, o seu prazo de pagamento. Serve da
+// cache quando a entrada está em dia; senão lê a partição e guarda o que leu.
+// *da_cache diz de onde veio a resposta.
+int consultarPNR(uint32_t pnr, time_t *prazo, int *da_cache) {
+    uint32_t h = hashConsulta(pnr);
+    FatiaConsulta *f = &fatias_consulta[h % FATIAS_CONSULTA];
+    EntradaConsulta *e = &f->entradas[h / FATIAS_CONSULTA];
+    int estado;
+
+    if (cache_consultas_ativa) {
+        uint32_t versao = atomic_load_explicit(&versao_consulta[h], memory_order_acquire);
+        uint32_t global = atomic_load_explicit(&versao_global_consulta, memory_order_acquire);
+        pthread_mutex_lock(&f->mutex);
+        if (e->pnr == pnr && e->versao == versao && e->versao_global == global) {
+            estado = e->estado;
+            *prazo = e->prazo;
+            pthread_mutex_unlock(&f->mutex);
+            atomic_fetch_add_explicit(&consultas_acertos, 1, memory_order_relaxed);
+            *da_cache = 1;
+            return estado;
+        }
+        if (e->pnr == pnr)
+            atomic_fetch_add_explicit(&consultas_obsoletas, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&f->mutex);
+    }
+    atomic_fetch_add_explicit(&consultas_falhas, 1, memory_order_relaxed);
+    *da_cache = 0;
+
+    // As alterações a este PNR sobem a versão com a partição bloqueada, por
+    // isso a versão lida aqui corresponde ao estado lido
+    int p = particaoDoPNR(pnr);
+    ArmazemPNR *a = bloquearPNR(p);
+    uint32_t versao = atomic_load_explicit(&versao_consulta[h], memory_order_relaxed);
+    uint32_t global = atomic_load_explicit(&versao_global_consulta, memory_order_relaxed);
+    int32_t i = procurarReserva(a, pnr);
+    estado = i == NENHUM ? ESTADO_INEXISTENTE : pagoDe(NO(a, i)) ? ESTADO_PAGO : ESTADO_POR_PAGAR;
+    *prazo = i == NENHUM ? 0 : prazoDe(NO(a, i));
+    desbloquearPNR(p);
+
+    if (cache_consultas_ativa) {
+        pthread_mutex_lock(&f->mutex);
+        e->pnr = pnr;
+        e->estado = estado;
+        e->prazo = *prazo;
+        e->versao = versao;
+        e->versao_global = global;
+        pthread_mutex_unlock(&f->mutex);
+    }
+    return estado;
+}
+
+// Prazo do PNR só pela cache, sem nunca bloquear a partição: retorna 1 se a
+// entrada está em dia e o PNR por pagar, com o prazo em *prazo
+int espreitarPrazo(uint32_t pnr, time_t *prazo) {
+    if (!cache_consultas_ativa)
+        return 0;
+    uint32_t h = hashConsulta(pnr);
+    FatiaConsulta *f = &fatias_consulta[h % FATIAS_CONSULTA];
+    EntradaConsulta *e = &f->entradas[h / FATIAS_CONSULTA];
+    uint32_t versao = atomic_load_explicit(&versao_consulta[h], memory_order_acquire);
+    uint32_t global = atomic_load_explicit(&versao_global_consulta, memory_order_acquire);
+    int encontrado = 0;
+    pthread_mutex_lock(&f->mutex);
+    if (e->pnr == pnr && e->versao == versao && e->versao_global == global && e->estado == ESTADO_POR_PAGAR) {
+        *prazo = e->prazo;
+        encontrado = 1;
+    }
+    pthread_mutex_unlock(&f->mutex);
+    return encontrado;
+}
+
+void imprimirMetricasConsultas() {
+    long acertos = atomic_load(&consultas_acertos), falhas = atomic_load(&consultas_falhas);
+    printf("Cache de consultas: %ld acerto(s), %ld falha(s) (%ld por invalidação), %.0f%% de acertos\n",
+           acertos, falhas, atomic_load(&consultas_obsoletas),
+           acertos + falhas ? 100.0 * acertos / (acertos + falhas) : 0.0);
+}
+
+// PNRs reservados mais recentemente: as consultas dos clientes concentram-se
+// neles (acabados de reservar, prestes a pagar)
+#define N_RECENTES 16
+atomic_uint pnrs_recentes[N_RECENTES]; // 0 = ainda nenhum (gerarPNR nunca dá 0)
+atomic_uint pos_recentes = 0;
+
+void registarRecente(uint32_t pnr) {
+    atomic_store(&pnrs_recentes[atomic_fetch_add(&pos_recentes, 1) % N_RECENTES], pnr);
+}
+
+// Insere uma reserva com os dados indicados no fim do vetor denso.
+// A ligação (posição) é escrita por último: uma morte a meio só perde este nó.
+int32_t inserirReserva(ArmazemPNR *a, uint32_t pnr, time_t timestamp, int pago) {
+    int32_t i = a->livre;
+    if (i == NENHUM) {
+        printf("Armazém de reservas cheio (%d).\n", a->capacidade);
+        return NENHUM;
+    }
+    int n = atomic_load_explicit(&a->n_reservas, memory_order_relaxed);
+    a->livre = PROXIMO_LIVRE(NO(a, i)->ligacao);
+    NO(a, i)->pnr = pnr;
+    NO(a, i)->estado = empacotarEstado(timestamp, pago);
+    tabelaInserir(a, i);
+    DENSOS(a)[n] = i;
+    NO(a, i)->ligacao = n;
+    atomic_store_explicit(&a->n_reservas, n + 1, memory_order_relaxed);
+    invalidarConsulta(pnr);
+    indiceInserir(timestamp + PRAZO_PAGAMENTO, pnr, pago);
+    return i;
+}
+
+// Retira o nó i da tabela de PNRs e do vetor denso (a última reserva ocupa o
+// seu lugar) e devolve-o à lista livre, sem mexer no índice por prazo. O(1).
+void desligarNo(ArmazemPNR *a, int32_t i) {
+    int n = atomic_load_explicit(&a->n_reservas, memory_order_relaxed);
+    tabelaRemover(a, i);
+    int32_t pos = NO(a, i)->ligacao;
+    int32_t ultimo = DENSOS(a)[n - 1];
+    DENSOS(a)[pos] = ultimo;
+    NO(a, ultimo)->ligacao = pos;
+    atomic_store_explicit(&a->n_reservas, n - 1, memory_order_relaxed);
+    NO(a, i)->ligacao = LIGACAO_LIVRE(a->livre);
+    a->livre = i;
+    invalidarConsulta(NO(a, i)->pnr);
+}
+
+// Como desligarNo, mas retira também a reserva do índice por prazo
+void libertarNo(ArmazemPNR *a, int32_t i) {
+    indiceRemover(prazoDe(NO(a, i)), NO(a, i)->pnr);
+    desligarNo(a, i);
+}
+
+// Marca como paga a reserva no nó i
+void marcarPago(ArmazemPNR *a, int32_t i) {
+    NO(a, i)->estado |= 1;
+    invalidarConsulta(NO(a, i)->pnr);
+    indiceMarcarPago(prazoDe(NO(a, i)), NO(a, i)->pnr);
+}
+
+// Remove a reserva com o PNR indicado. Retorna 1 se existia.
+int removerReserva(ArmazemPNR *a, uint32_t pnr) {
+    int32_t i = procurarReserva(a, pnr);
+    if (i == NENHUM)
+        return 0;
+    libertarNo(a, i);
+    return 1;
+}
+
+// Esvazia a partição (usado pelo snapshot da réplica)
+void limparReservas(ArmazemPNR *a) {
+    while (atomic_load_explicit(&a->n_reservas, memory_order_relaxed) > 0)
+        libertarNo(a, DENSOS(a)[0]);
+}
+
+// Reserva o PNR indicado, que ainda não existe na sua partição (a de a).
+// Retorna o PNR ou PNR_INVALIDO se a partição estiver cheia.
+uint32_t registarReserva(ArmazemPNR *a, uint32_t pnr) {
+    int32_t novoNo = inserirReserva(a, pnr, relogioAgora(), 0);
+    if (novoNo == NENHUM)
+        return PNR_INVALIDO;
+    emitirEvento(EVENTO_RESERVA, pnr, momentoDe(NO(a, novoNo)), 0);
+    printf("Reserva realizada: %s\n", textoPNR(pnr).texto);
+    return pnr;
+}
+
+#define TENTATIVAS_PNR 64 // sorteios de PNR antes de desistir
+
+// Função que insere uma nova reserva na partição p (com um PNR ainda não usado,
+// para que a réplica e as consultas identifiquem a reserva sem ambiguidade).
+// Retorna o PNR reservado, ou PNR_INVALIDO se a partição está cheia ou se nenhum
+// dos TENTATIVAS_PNR sorteios deu um PNR livre (os PNRs da partição estão
+// esgotados ou quase: as reservas pagas não expiram).
+uint32_t adicionarReserva(ArmazemPNR *a, int p) {
+    for (int t = 0; t < TENTATIVAS_PNR; t++) {
+        uint32_t pnr = gerarPNR(p);
+        if (procurarReserva(a, pnr) == NENHUM)
+            return registarReserva(a, pnr);
+    }
+    printf("Sem PNRs livres na partição %d.\n", p);
+    return PNR_INVALIDO;
+}
+
+// Função que remove uma reserva aleatória (uniforme) da partição e retorna o
+// PNR removido. Retorna 1 se removeu uma reserva ou 0 se estava vazia. O(1).
+int removerReservaAleatoria(ArmazemPNR *a, uint32_t *pnrRemovido) {
+    int n = atomic_load_explicit(&a->n_reservas, memory_order_relaxed);
+    if (n == 0)
+        return 0;
+    int32_t i = DENSOS(a)[aleatorio(n)]; // posição aleatória
+    *pnrRemovido = NO(a, i)->pnr;
+    libertarNo(a, i);
+    return 1;
+}
+
+// Função que seleciona uma reserva aleatória (sem removê-la) e retorna seu PNR. O(1).
+int obterReservaAleatoria(ArmazemPNR *a, uint32_t *pnr) {
+    int n = atomic_load_explicit(&a->n_reservas, memory_order_relaxed);
+    if (n == 0)
+        return 0;
+    *pnr = NO(a, DENSOS(a)[aleatorio(n)])->pnr;
+    return 1;
+}
+
+// Escolhe k reservas distintas da partição (Fisher-Yates parcial sobre o vetor
+// denso: as k primeiras posições ficam com a amostra). Retorna quantas escolheu.
+int amostrarParticao(ArmazemPNR *a, int k, uint32_t *pnrs) {
+    int n = atomic_load_explicit(&a->n_reservas, memory_order_relaxed);
+    if (k > n)
+        k = n;
+    for (int j = 0; j < k; j++) {
+        int r = j + aleatorio(n - j);
+        int32_t nj = DENSOS(a)[j], nr = DENSOS(a)[r];
+        DENSOS(a)[j] = nr;
+        NO(a, nr)->ligacao = j;
+        DENSOS(a)[r] = nj;
+        NO(a, nj)->ligacao = r;
+        pnrs[j] = NO(a, nr)->pnr;
+    }
+    return k;
+}
+
+// Escolhe até k reservas distintas de todo o armazenamento: cada uma das k
+// escolhas vai para uma partição com probabilidade proporcional ao seu
+// tamanho, e cada partição é amostrada sob o seu próprio mutex.
+int amostrarReservas(int k, uint32_t *pnrs) {
+    int por_particao[MAX_PARTICOES] = {0};
+    int total = 0;
+    for (int j = 0; j < k; j++)
+        por_particao[escolherParticao()]++;
+    for (int p = 0; p < n_particoes; p++) {
+        if (por_particao[p] == 0)
+            continue;
+        ArmazemPNR *a = bloquearPNR(p);
+        total += amostrarParticao(a, por_particao[p], pnrs + total);
+        desbloquearPNR(p);
+    }
+    return total;
+}
+
+// Regista o fim de uma operação e avisa a drenagem quando já não há nenhuma.
+void terminarOperacao() {
+    if (atomic_fetch_sub(&operacoes_em_curso, 1) == 1 && atomic_load(&estado_motor) != MOTOR_ATIVO) {
+        pthread_mutex_lock(&drenagem_mutex);
+        pthread_cond_broadcast(&drenagem_cond);
+        pthread_mutex_unlock(&drenagem_mutex);
+    }
+}
+
+// Regista o início de uma operação. Retorna 0 (e não regista) se o motor já
+// não estiver a admitir operações.
+int admitirOperacao() {
+    atomic_fetch_add(&operacoes_em_curso, 1);
+    if (atomic_load(&estado_motor) != MOTOR_ATIVO) {
+        terminarOperacao();
+        return 0;
+    }
+    return 1;
+}
+
+int motorAtivo() {
+    return atomic_load(&estado_motor) == MOTOR_ATIVO;
+}
+
+static int continuarMotorAtivo(void *ctx) {
+    (void)ctx;
+    return motorAtivo();
+}
+
+// Espera "segundos" (do relógio) ou até o motor sair do estado ativo.
+// Retorna 1 se o motor continua ativo, 0 se a thread deve terminar.
+int esperarOuDrenar(int segundos) {
+    if (relogio_virtual) {
+        relogioDormirAte(relogioAgoraMs() + segundos * 1000LL, continuarMotorAtivo, NULL);
+        return motorAtivo();
+    }
+    struct timespec prazo;
+    clock_gettime(CLOCK_REALTIME, &prazo);
+    prazo.tv_sec += segundos;
+
+    pthread_mutex_lock(&drenagem_mutex);
+    while (atomic_load(&estado_motor) == MOTOR_ATIVO) {
+        if (pthread_cond_timedwait(&drenagem_cond, &drenagem_mutex, &prazo) != 0)
+            break; // prazo atingido
+    }
+    pthread_mutex_unlock(&drenagem_mutex);
+    return atomic_load(&estado_motor) == MOTOR_ATIVO;
+}
+
+// SIGINT/SIGTERM pedem a drenagem em vez de matar o processo. Um segundo
+// sinal durante a drenagem sai logo (para quando a drenagem não termina).
+void pedirDrenagem(int sinal) {
+    int ativo = MOTOR_ATIVO;
+    if (atomic_compare_exchange_strong(&estado_motor, &ativo, MOTOR_DRENANDO) || sinal == 0)
+        return;
+    static const char aviso[] = "\n[Drenagem] Segundo sinal: saída imediata.\n";
+    ssize_t escrito = write(STDERR_FILENO, aviso, sizeof(aviso) - 1);
+    (void)escrito; // sai de qualquer forma
+    _exit(128 + sinal);
+}
+
+// ===================== Replicação primário -> réplica =====================
+// O primário acumula os eventos (reserva/pagamento/cancelamento/expiração) e
+// uma thread envia-os em lotes por um socket Unix ou TCP local. A réplica
+// aplica-os à sua própria lista e serve consultas sem tocar no primário.
+// Com --promover-apos S a réplica que fica S segundos sem primário (ou que
+// recebe SIGUSR2) é promovida: deixa de aceitar o primário e passa a correr
+// o motor completo sobre as reservas que replicou. Não há vedação do antigo
+// primário: quem o substitui deve garantir que ele não volta.
+
+#define LOTE_REPLICACAO 64          // envia logo que houver este número de eventos
+#define INTERVALO_REPLICACAO_MS 100 // ou, no máximo, com este atraso
+#define MAX_EVENTOS_LOTE 65536      // eventos por lote na ligação; um cabeçalho com mais é inválido
+#define REPLICA_PROMOVIDA 2         // executarReplica: a réplica passou a primário
+
+typedef struct {
+    uint32_t n_eventos;
+    uint32_t reservado;
+    uint64_t seq_primario; // último seq emitido pelo primário no momento do envio
+} CabecalhoLote;
+
+const char *destino_replicacao = NULL; // definido por --primario
+int modo_replica = 0;                  // definido por --replica
+
+pthread_mutex_t replicacao_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t replicacao_cond = PTHREAD_COND_INITIALIZER;
+EventoReplicacao *eventos_pendentes = NULL;
+size_t n_pendentes = 0, capacidade_pendentes = 0;
+uint64_t seq_replicacao = 0;
+int replicacao_ligada = 0; // só acumula eventos enquanto há uma réplica ligada
+int parar_replicacao = 0;
+
+// Métricas (primário e réplica)
+atomic_ulong eventos_enviados = 0, lotes_enviados = 0, reconexoes_replica = 0;
+atomic_ulong eventos_aplicados = 0, lotes_aplicados = 0;
+atomic_ulong seq_aplicado = 0, seq_visto_primario = 0;
+atomic_long atraso_ultimo_ms = 0, atraso_maximo_ms = 0;
+int fd_escuta_replica = -1, fd_ligacao_replica = -1;
+int promover_apos_s = 0;                 // definido por --promover-apos (0 = nunca)
+atomic_int pedido_promocao = 0;          // SIGUSR2 na réplica
+atomic_llong sem_primario_desde_ms = 0;  // 0 enquanto o primário está ligado
+
+int64_t agoraMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Espera no máximo ms milissegundos que *p deixe de valer valor. Os futexes
+// não são privados: servem entre processos.
+void futexEsperar(atomic_uint *p, unsigned valor, long ms) {
+    struct timespec t = { ms / 1000, (ms % 1000) * 1000000 };
+    syscall(SYS_futex, p, FUTEX_WAIT, valor, &t, NULL, 0);
+}
+
+void futexAcordar(atomic_uint *p, int n) {
+    syscall(SYS_futex, p, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+// Escreve/lê exatamente n bytes. Retorna 0 em caso de sucesso, -1 em erro/fim.
+int escreverTudo(int fd, const void *buf, size_t n) {
+    const char *p = buf;
+    while (n > 0) {
+        ssize_t r = send(fd, p, n, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        n -= r;
+    }
+    return 0;
+}
+
+int lerTudo(int fd, void *buf, size_t n) {
+    char *p = buf;
+    while (n > 0) {
+        ssize_t r = recv(fd, p, n, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        n -= r;
+    }
+    return 0;
+}
+
+// Abre o destino: "tcp:PORTA" (127.0.0.1) ou o caminho de um socket Unix.
+// servidor=1 faz bind/listen (réplica), servidor=0 faz connect (primário).
+int abrirLigacao(const char *destino, int servidor) {
+    int fd;
+    if (strncmp(destino, "tcp:", 4) == 0) {
+        struct sockaddr_in end = { .sin_family = AF_INET, .sin_port = htons(atoi(destino + 4)) };
+        end.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1)
+            return -1;
+        int um = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &um, sizeof(um));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &um, sizeof(um));
+        if (servidor ? (bind(fd, (struct sockaddr*)&end, sizeof(end)) == -1 || listen(fd, 64) == -1)
+                     : connect(fd, (struct sockaddr*)&end, sizeof(end)) == -1) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        struct sockaddr_un end = { .sun_family = AF_UNIX };
+        snprintf(end.sun_path, sizeof(end.sun_path), "%s", destino);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1)
+            return -1;
+        if (servidor)
+            unlink(destino);
+        if (servidor ? (bind(fd, (struct sockaddr*)&end, sizeof(end)) == -1 || listen(fd, 64) == -1)
+                     : connect(fd, (struct sockaddr*)&end, sizeof(end)) == -1) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// Acrescenta um evento à fila de replicação. Deve ser chamada com replicacao_mutex bloqueado.
+void acrescentarEvento(int tipo, uint32_t pnr, time_t timestamp, int pago) {
+    if (n_pendentes == capacidade_pendentes) {
+        size_t nova = capacidade_pendentes ? capacidade_pendentes * 2 : 256;
+        EventoReplicacao *novo = realloc(eventos_pendentes, nova * sizeof(EventoReplicacao));
+        if (!novo) {
+            perror("Erro ao alocar memória");
+            return;
+        }
+        eventos_pendentes = novo;
+        capacidade_pendentes = nova;
+    }
+    EventoReplicacao *e = &eventos_pendentes[n_pendentes++];
+    e->seq = ++seq_replicacao;
+    e->instante_ms = agoraMs();
+    e->timestamp = timestamp;
+    e->pnr = pnr;
+    e->tipo = tipo;
+    e->pago = pago;
+}
+
+// Chamada pelas operações com o armazenamento bloqueado, para que a ordem dos
+// eventos seja a mesma das alterações à lista.
+void emitirEvento(int tipo, uint32_t pnr, time_t timestamp, int pago) {
+    publicarCDC(tipo, pnr, timestamp, pago);
+    if (destino_replicacao == NULL)
+        return;
+    pthread_mutex_lock(&replicacao_mutex);
+    if (replicacao_ligada) {
+        acrescentarEvento(tipo, pnr, timestamp, pago);
+        if (n_pendentes >= LOTE_REPLICACAO)
+            pthread_cond_signal(&replicacao_cond);
+    }
+    pthread_mutex_unlock(&replicacao_mutex);
+}
+
+// Ao (re)ligar, envia o estado completo: um marcador SNAPSHOT seguido de uma
+// RESERVA por cada reserva existente. Os eventos seguintes vêm por ordem.
+void prepararSnapshot() {
+    for (int p = 0; p < n_particoes; p++) // sempre pela mesma ordem
+        bloquearPNR(p);
+    pthread_mutex_lock(&replicacao_mutex);
+    n_pendentes = 0;
+    acrescentarEvento(EVENTO_SNAPSHOT, 0, 0, 0);
+    for (int p = 0; p < n_particoes; p++) {
+        ArmazemPNR *a = meuPNR[p];
+        for (int k = 0; k < a->n_reservas; k++) {
+            PNRNode *no = NO(a, DENSOS(a)[k]);
+            acrescentarEvento(EVENTO_RESERVA, no->pnr, momentoDe(no), pagoDe(no));
+        }
+    }
+    replicacao_ligada = 1;
+    pthread_mutex_unlock(&replicacao_mutex);
+    for (int p = n_particoes - 1; p >= 0; p--)
+        desbloquearPNR(p);
+}
+
+// Thread do primário: liga-se à réplica e envia os eventos em lotes
+void* replicacao_thread(void* arg) {
+    EventoReplicacao *envio = NULL;
+    size_t capacidade_envio = 0;
+    int fd = -1;
+
+    pthread_mutex_lock(&replicacao_mutex);
+    while (!parar_replicacao || (fd != -1 && n_pendentes > 0)) {
+        if (fd == -1) {
+            pthread_mutex_unlock(&replicacao_mutex);
+            fd = abrirLigacao(destino_replicacao, 0);
+            if (fd != -1) {
+                atomic_fetch_add(&reconexoes_replica, 1);
+                printf("[Replicação] Ligado à réplica em %s.\n", destino_replicacao);
+                prepararSnapshot();
+            }
+            pthread_mutex_lock(&replicacao_mutex);
+            if (fd == -1) { // tenta de novo daqui a 1 segundo
+                struct timespec prazo;
+                clock_gettime(CLOCK_REALTIME, &prazo);
+                prazo.tv_sec += 1;
+                if (!parar_replicacao)
+                    pthread_cond_timedwait(&replicacao_cond, &replicacao_mutex, &prazo);
+                if (parar_replicacao)
+                    break;
+            }
+            continue;
+        }
+
+        if (n_pendentes < LOTE_REPLICACAO && !parar_replicacao) {
+            struct timespec prazo;
+            clock_gettime(CLOCK_REALTIME, &prazo);
+            prazo.tv_nsec += INTERVALO_REPLICACAO_MS * 1000000L;
+            if (prazo.tv_nsec >= 1000000000L) {
+                prazo.tv_sec++;
+                prazo.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&replicacao_cond, &replicacao_mutex, &prazo);
+        }
+        if (n_pendentes == 0)
+            continue;
+
+        // Troca os buffers para enviar fora do mutex
+        EventoReplicacao *tmp = envio;
+        size_t tmp_cap = capacidade_envio;
+        envio = eventos_pendentes;
+        capacidade_envio = capacidade_pendentes;
+        size_t n = n_pendentes;
+        uint64_t seq = seq_replicacao;
+        eventos_pendentes = tmp;
+        capacidade_pendentes = tmp_cap;
+        n_pendentes = 0;
+        pthread_mutex_unlock(&replicacao_mutex);
+
+        // Em lotes de no máximo MAX_EVENTOS_LOTE (um snapshot pode ter milhões)
+        int falhou = 0;
+        for (size_t k = 0; k < n && !falhou; k += MAX_EVENTOS_LOTE) {
+            CabecalhoLote cab = { .n_eventos = n - k < MAX_EVENTOS_LOTE ? n - k : MAX_EVENTOS_LOTE,
+                                  .seq_primario = seq };
+            falhou = escreverTudo(fd, &cab, sizeof(cab)) == -1 ||
+                     escreverTudo(fd, envio + k, cab.n_eventos * sizeof(EventoReplicacao)) == -1;
+            if (!falhou)
+                atomic_fetch_add(&lotes_enviados, 1);
+        }
+        if (falhou) {
+            printf("[Replicação] Ligação à réplica perdida; a tentar de novo.\n");
+            close(fd);
+            fd = -1;
+            pthread_mutex_lock(&replicacao_mutex);
+            replicacao_ligada = 0; // o próximo snapshot substitui o que se perdeu
+            n_pendentes = 0;
+            continue;
+        }
+        atomic_fetch_add(&eventos_enviados, n);
+        pthread_mutex_lock(&replicacao_mutex);
+    }
+    replicacao_ligada = 0;
+    pthread_mutex_unlock(&replicacao_mutex);
+
+    if (fd != -1)
+        close(fd);
+    free(envio);
+    return NULL;
+}
+
+// Envia o que falta e termina a thread de replicação (usada na drenagem)
+void pararReplicacao(pthread_t thread) {
+    pthread_mutex_lock(&replicacao_mutex);
+    parar_replicacao = 1;
+    pthread_cond_broadcast(&replicacao_cond);
+    pthread_mutex_unlock(&replicacao_mutex);
+    pthread_join(thread, NULL);
+    free(eventos_pendentes);
+    eventos_pendentes = NULL;
+}
+
+// Aplica um evento recebido na partição local correspondente da réplica
+void aplicarEvento(const EventoReplicacao *e) {
+    if (e->tipo == EVENTO_SNAPSHOT) { // recomeça do zero
+        for (int p = 0; p < n_particoes; p++) {
+            limparReservas(bloquearPNR(p));
+            desbloquearPNR(p);
+        }
+        return;
+    }
+
+    int p = particaoDoPNR(e->pnr);
+    ArmazemPNR *a = bloquearPNR(p);
+    int32_t no;
+    switch (e->tipo) {
+        case EVENTO_RESERVA:
+            if (procurarReserva(a, e->pnr) == NENHUM)
+                inserirReserva(a, e->pnr, (time_t)e->timestamp, e->pago);
+            break;
+        case EVENTO_PAGAMENTO:
+            if ((no = procurarReserva(a, e->pnr)) != NENHUM)
+                marcarPago(a, no);
+            break;
+        case EVENTO_CANCELAMENTO:
+        case EVENTO_EXPIRACAO:
+            removerReserva(a, e->pnr);
+            break;
+    }
+    desbloquearPNR(p);
+}
+
+// Thread da réplica: aceita o primário e aplica os lotes recebidos
+void* receptor_replica(void* arg) {
+    EventoReplicacao *lote = NULL;
+    size_t capacidade = 0;
+
+    while (atomic_load(&estado_motor) == MOTOR_ATIVO) {
+        int fd = accept(fd_escuta_replica, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            break; // socket fechado pela drenagem
+        }
+        fd_ligacao_replica = fd;
+        atomic_store(&sem_primario_desde_ms, 0);
+        printf("[Réplica] Primário ligado.\n");
+
+        CabecalhoLote cab;
+        while (lerTudo(fd, &cab, sizeof(cab)) == 0) {
+            if (cab.n_eventos == 0)
+                continue; // nada a aplicar
+            if (cab.n_eventos > MAX_EVENTOS_LOTE) {
+                printf("[Réplica] Lote inválido (%u eventos); a fechar a ligação.\n", cab.n_eventos);
+                break;
+            }
+            if (cab.n_eventos > capacidade) {
+                EventoReplicacao *novo = realloc(lote, cab.n_eventos * sizeof(EventoReplicacao));
+                if (!novo)
+                    break;
+                lote = novo;
+                capacidade = cab.n_eventos;
+            }
+            if (lerTudo(fd, lote, cab.n_eventos * sizeof(EventoReplicacao)) == -1)
+                break;
+
+            for (uint32_t i = 0; i < cab.n_eventos; i++)
+                aplicarEvento(&lote[i]);
+
+            // Atraso = tempo entre o evento no primário e a sua aplicação aqui
+            int64_t atraso = agoraMs() - lote[cab.n_eventos - 1].instante_ms;
+            atomic_store(&atraso_ultimo_ms, atraso);
+            if (atraso > atomic_load(&atraso_maximo_ms))
+                atomic_store(&atraso_maximo_ms, atraso);
+            atomic_store(&seq_aplicado, lote[cab.n_eventos - 1].seq);
+            atomic_store(&seq_visto_primario, cab.seq_primario);
+            atomic_fetch_add(&eventos_aplicados, cab.n_eventos);
+            atomic_fetch_add(&lotes_aplicados, 1);
+        }
+        printf("[Réplica] Ligação ao primário terminada.\n");
+        fd_ligacao_replica = -1;
+        atomic_store(&sem_primario_desde_ms, agoraMs());
+        close(fd);
+    }
+    free(lote);
+    return NULL;
+}
+
+void imprimirMetricasReplicacao() {
+    if (modo_replica) {
+        printf("[Réplica] eventos aplicados: %lu em %lu lotes | seq aplicado: %lu (primário: %lu) | atraso: %ld ms (máx. %ld ms)\n",
+               atomic_load(&eventos_aplicados), atomic_load(&lotes_aplicados),
+               atomic_load(&seq_aplicado), atomic_load(&seq_visto_primario),
+               atomic_load(&atraso_ultimo_ms), atomic_load(&atraso_maximo_ms));
+    } else if (destino_replicacao) {
+        pthread_mutex_lock(&replicacao_mutex);
+        size_t pendentes = n_pendentes;
+        uint64_t seq = seq_replicacao;
+        pthread_mutex_unlock(&replicacao_mutex);
+        printf("[Replicação] seq: %lu | enviados: %lu em %lu lotes | pendentes: %zu | ligações: %lu\n",
+               (unsigned long)seq, atomic_load(&eventos_enviados), atomic_load(&lotes_enviados),
+               pendentes, atomic_load(&reconexoes_replica));
+    }
+}
+
+// Função para exibir todas as reservas atuais
+void imprimirReservas() {
+    printf("\n=== Reservas Atuais ===\n");
+    for (int p = 0; p < n_particoes; p++) {
+        ArmazemPNR *a = bloquearPNR(p);
+        for (int k = 0; k < a->n_reservas; k++)
+            printf("PNR: %s\n", textoPNR(NO(a, DENSOS(a)[k])->pnr).texto);
+        desbloquearPNR(p);
+    }
+}
+
+// ===================== Registo de operações =====================
+// Com --gravar FICHEIRO cada reserva, consulta, pagamento, cancelamento e
+// expiração fica num registo binário de 24 bytes (instante, número de ordem,
+// thread, PNR, operação, resultado). Cada thread junta os seus registos num
+// buffer próprio, sem bloqueios, e só o despeja no ficheiro (com o mutex)
+// quando enche; os buffers que sobram são despejados no fim. O ficheiro começa
+// por um cabeçalho com a semente e a hora do início, por isso dá para repetir
+// a mesma execução e, com --reproduzir, voltar a dar ao motor as mesmas
+// operações (ver reproduzirTraco).
+#define MAGIA_TRACO 0x54524331 // "TRC1"
+#define REGISTOS_POR_BUFFER 4096
+
+const char *NOMES_OPS[] = { "", "reserva", "consulta", "pagamento", "cancelamento", "expiração" };
+
+typedef struct {
+    uint32_t magia;
+    uint32_t relogio_virtual;
+    uint64_t semente;
+    int64_t inicio_ms;   // relógio do motor no instante 0
+    int32_t n_particoes;
+    int32_t tamanho_registo;
+} CabecalhoTraco;
+
+typedef struct {
+    int64_t instante_us; // desde o início do registo, no relógio do motor
+    uint64_t ordem;      // ordem global (no mesmo milissegundo virtual cabem várias)
+    uint32_t pnr;        // PNR_INVALIDO = operação sem PNR
+    uint16_t thread;
+    uint8_t op;
+    uint8_t resultado;   // RESULTADO_*
+} RegistoTraco;
+
+_Static_assert(sizeof(RegistoTraco) == 24, "RegistoTraco deve ter 24 bytes");
+
+typedef struct BufferTraco {
+    int n;
+    uint16_t thread;
+    struct BufferTraco *prox;
+    RegistoTraco registos[REGISTOS_POR_BUFFER];
+} BufferTraco;
+
+FILE *ficheiro_traco = NULL;
+const char *nome_traco = NULL;
+pthread_mutex_t traco_mutex = PTHREAD_MUTEX_INITIALIZER;
+BufferTraco *buffers_traco = NULL; // todos os buffers, para o despejo final
+__thread BufferTraco *buffer_traco = NULL;
+atomic_int threads_traco = 0;
+atomic_long registos_traco = 0;
+atomic_long registos_perdidos = 0; // sem memória para o buffer da thread
+atomic_ullong ordem_traco = 0;
+int64_t inicio_traco_ms, inicio_traco_ns;
+
+// Instante desde o início do registo: em simulação conta o tempo virtual,
+// senão o relógio monótono (em microssegundos)
+int64_t instanteTraco() {
+    if (relogio_virtual)
+        return (relogioAgoraMs() - inicio_traco_ms) * 1000;
+    return (agoraNs() - inicio_traco_ns) / 1000;
+}
+
+// Marca o instante 0 do registo (e da reprodução)
+void iniciarInstantes() {
+    inicio_traco_ms = relogioAgoraMs();
+    inicio_traco_ns = agoraNs();
+}
+
+int abrirTraco(const char *nome, uint64_t semente) {
+    ficheiro_traco = fopen(nome, "wb");
+    if (!ficheiro_traco) {
+        perror("Erro ao abrir o registo de operações");
+        return -1;
+    }
+    iniciarInstantes();
+    CabecalhoTraco c = { MAGIA_TRACO, relogio_virtual, semente, inicio_traco_ms, n_particoes, sizeof(RegistoTraco) };
+    fwrite(&c, sizeof c, 1, ficheiro_traco);
+    nome_traco = nome;
+    return 0;
+}
+
+void despejarTraco(BufferTraco *b) {
+    pthread_mutex_lock(&traco_mutex);
+    fwrite(b->registos, sizeof(RegistoTraco), b->n, ficheiro_traco);
+    pthread_mutex_unlock(&traco_mutex);
+    atomic_fetch_add_explicit(&registos_traco, b->n, memory_order_relaxed);
+    b->n = 0;
+}
+
+// Acrescenta um registo ao buffer da thread; sem --gravar não faz nada
+void gravarTraco(int op, uint32_t pnr, int resultado) {
+    if (!ficheiro_traco)
+        return;
+    BufferTraco *b = buffer_traco;
+    if (!b) {
+        b = malloc(sizeof(BufferTraco));
+        if (!b) {
+            // O registo fica incompleto (fecharTraco avisa); a operação continua
+            atomic_fetch_add_explicit(&registos_perdidos, 1, memory_order_relaxed);
+            return;
+        }
+        buffer_traco = b;
+        b->n = 0;
+        b->thread = atomic_fetch_add(&threads_traco, 1);
+        pthread_mutex_lock(&traco_mutex);
+        b->prox = buffers_traco;
+        buffers_traco = b;
+        pthread_mutex_unlock(&traco_mutex);
+    }
+    uint64_t ordem = atomic_fetch_add_explicit(&ordem_traco, 1, memory_order_relaxed);
+    b->registos[b->n++] = (RegistoTraco){ instanteTraco(), ordem, pnr, b->thread, op, resultado };
+    if (b->n == REGISTOS_POR_BUFFER)
+        despejarTraco(b);
+}
+
+// Despeja o que ficou nos buffers e fecha o ficheiro. Só com as threads que
+// gravam já paradas.
+void fecharTraco() {
+    if (!ficheiro_traco)
         return;
+    while (buffers_traco) {
+        BufferTraco *b = buffers_traco;
+        buffers_traco = b->prox;
+        despejarTraco(b);
+        free(b);
     }
-    novoNo->pnr = gerarPNR();
-    novoNo->timestamp = time(NULL);
-    novoNo->next = meuPNR;
-    meuPNR = novoNo;
-    printf("Reserva realizada: %d\n", novoNo->pnr);
+    fclose(ficheiro_traco);
+    ficheiro_traco = NULL;
+    printf("Registo de operações: %ld registo(s) de %d thread(s) em %s\n",
+           atomic_load(&registos_traco), atomic_load(&threads_traco), nome_traco);
+    if (atomic_load(&registos_perdidos))
+        fprintf(stderr, "Aviso: %ld operação(ões) não registada(s) por falta de memória; o registo não é reproduzível\n",
+                atomic_load(&registos_perdidos));
 }
 
-// Função que remove um nó aleatório da lista e retorna o PNR removido.
-// Retorna 1 se removeu uma reserva ou 0 se a lista estava vazia.
-int removerReservaAleatoria(int *pnrRemovido) {
-    if (meuPNR == NULL)
-        return 0;
-    int count = 0;
-    PNRNode *temp = meuPNR;
-    while (temp) {
-        count++;
-        temp = temp->next;
-    }
-    int index = rand() % count; // índice aleatório
-    PNRNode *atual = meuPNR;
-    PNRNode *anterior = NULL;
-    for (int i = 0; i < index; i++) {
-        anterior = atual;
-        atual = atual->next;
-    }
-    if (anterior == NULL)
-        meuPNR = atual->next;
+int compararRegistos(const void *x, const void *y) {
+    const RegistoTraco *a = x, *b = y;
+    return (a->ordem > b->ordem) - (a->ordem < b->ordem);
+}
+
+// Lê um registo gravado com --gravar e põe-no pela ordem em que as operações
+// acabaram (os buffers das várias threads ficam intercalados no ficheiro).
+// Retorna o número de registos, ou -1.
+long lerTraco(const char *nome, CabecalhoTraco *c, RegistoTraco **registos) {
+    FILE *f = fopen(nome, "rb");
+    if (!f) {
+        perror("Erro ao abrir o registo de operações");
+        return -1;
+    }
+    if (fread(c, sizeof *c, 1, f) != 1 || c->magia != MAGIA_TRACO ||
+        c->tamanho_registo != sizeof(RegistoTraco)) {
+        fprintf(stderr, "%s não é um registo de operações\n", nome);
+        fclose(f);
+        return -1;
+    }
+    long n = 0, capacidade = REGISTOS_POR_BUFFER;
+    RegistoTraco *v = malloc(capacidade * sizeof *v);
+    if (!v) {
+        perror("Erro ao alocar memória");
+        fclose(f);
+        return -1;
+    }
+    while (fread(&v[n], sizeof *v, 1, f) == 1) {
+        if (++n == capacidade) {
+            RegistoTraco *novo = realloc(v, (capacidade * 2) * sizeof *v);
+            if (!novo) {
+                perror("Erro ao alocar memória");
+                free(v);
+                fclose(f);
+                return -1;
+            }
+            v = novo;
+            capacidade *= 2;
+        }
+    }
+    fclose(f);
+    qsort(v, n, sizeof *v, compararRegistos);
+    *registos = v;
+    return n;
+}
+
+// ===================== Lista de espera por voo =====================
+// Com --lugares N cada partição é um voo com N lugares. Uma reserva num voo
+// cheio não falha logo: o cliente entra na lista de espera do voo (FIFO,
+// protegida pelo mutex da partição) e fica a dormir num futex só seu. Quando
+// um cancelamento ou uma expiração liberta lugares, entregarLugares reserva-os
+// em nome dos clientes mais antigos e acorda exatamente esses, um a um, sem
+// acordar os outros. Enquanto há alguém na lista, as reservas novas não
+// passam à frente: também entram na lista. A lista é do processo: com --shm
+// os lugares libertados por outros processos só são vistos na reserva
+// seguinte. Quem espera mais de PRAZO_ESPERA_LUGAR segundos do relógio do
+// motor desiste; em tempo virtual o cliente dorme no relógio virtual (é um
+// participante) em vez do futex. Quem tira um cliente da lista para o servir
+// ou despedir fica com uma referência ao seu registo até o acordar: o cliente
+// pode ver o novo estado antes disso, e o último a largar o registo liberta-o.
+// A drenagem dorme num futex até sair o último cliente. O pedido do cliente
+// fica na tabela de pedidos com RESULTADO_EM_ESPERA enquanto ele está na
+// lista e conclui-se com o PNR entregue, ou com RESULTADO_CHEIO se o cliente
+// sai sem lugar.
+#define MAX_ESPERA_VOO 64
+#define PRAZO_ESPERA_LUGAR 30
+#define LOTE_ENTREGA 16
+
+enum { ESPERA_A_ESPERAR = 0, ESPERA_SERVIDA, ESPERA_ENCERRADA };
+
+typedef struct EsperaLugar {
+    atomic_uint estado;        // futex do cliente
+    atomic_int referencias;    // o cliente e, durante a entrega, quem o tirou da lista
+    int na_lista;              // com o mutex da partição
+    uint32_t pnr;              // reservado em nome do cliente
+    uint64_t id;               // pedido do cliente (0 = sem ID)
+    int particao;
+    int64_t chegada_ns;
+    struct EsperaLugar *prox;
+} EsperaLugar;
+
+typedef struct {
+    EsperaLugar *primeiro, *ultimo;
+    atomic_int profundidade, profundidade_max;
+    atomic_long entradas, recusadas, servidas, desistencias, espera_total_ns, espera_max_ns;
+} ListaEspera;
+
+int lugares_por_voo = 0; // --lugares (0 = sem limite além de CAPACIDADE_PNR)
+ListaEspera listas_espera[MAX_PARTICOES];
+atomic_uint clientes_a_esperar = 0; // threads de clientes na lista (futex da drenagem)
+
+// Instante para as esperas, no relógio do motor
+static inline int64_t instanteEsperaNs() {
+    return relogio_virtual ? relogioAgoraMs() * 1000000 : agoraNs();
+}
+
+// Acorda um cliente da lista depois de lhe mudar o estado
+static inline void acordarEspera(EsperaLugar *e) {
+    if (relogio_virtual)
+        relogioAcordarContexto(e);
     else
-        anterior->next = atual->next;
-    *pnrRemovido = atual->pnr;
-    free(atual);
-    return 1;
+        futexAcordar(&e->estado, 1);
+}
+
+// Larga uma referência ao registo do cliente; a última liberta-o
+static inline void largarEspera(EsperaLugar *e) {
+    if (atomic_fetch_sub_explicit(&e->referencias, 1, memory_order_acq_rel) == 1)
+        free(e);
+}
+
+// Uma thread de cliente terminou; a drenagem acorda com a última
+static inline void clienteSaiuDaEspera() {
+    if (atomic_fetch_sub(&clientes_a_esperar, 1) == 1)
+        futexAcordar(&clientes_a_esperar, 1);
+}
+
+static int continuarEspera(void *ctx) {
+    return atomic_load_explicit(&((EsperaLugar*)ctx)->estado, memory_order_acquire) == ESPERA_A_ESPERAR;
+}
+
+// Com a partição bloqueada: uma reserva nova não tem lugar se o voo estiver
+// cheio ou se já houver clientes à espera
+int vooCheio(ArmazemPNR *a, int p) {
+    return lugares_por_voo && (a->n_reservas >= lugares_por_voo || listas_espera[p].primeiro);
+}
+
+// Reserva os lugares livres do voo p para os clientes mais antigos da lista e
+// acorda-os. Chamada depois de um cancelamento ou de uma expiração, já com a
+// libertação registada.
+void entregarLugares(int p) {
+    ListaEspera *l = &listas_espera[p];
+    EsperaLugar *servidos[LOTE_ENTREGA];
+    int n;
+    do {
+        if (atomic_load(&l->profundidade) == 0)
+            return;
+        n = 0;
+        ArmazemPNR *a = bloquearPNR(p);
+        while (n < LOTE_ENTREGA && l->primeiro && a->n_reservas < lugares_por_voo) {
+            uint32_t pnr = adicionarReserva(a, p);
+            if (pnr == PNR_INVALIDO)
+                break;
+            EsperaLugar *e = l->primeiro;
+            l->primeiro = e->prox;
+            if (!l->primeiro)
+                l->ultimo = NULL;
+            e->na_lista = 0;
+            e->pnr = pnr;
+            atomic_fetch_add_explicit(&e->referencias, 1, memory_order_relaxed);
+            atomic_fetch_sub(&l->profundidade, 1);
+            servidos[n++] = e;
+        }
+        desbloquearPNR(p);
+
+        // Acorda fora do bloqueio, para o cliente não esbarrar nele
+        for (int k = 0; k < n; k++) {
+            gravarTraco(OP_RESERVAR, servidos[k]->pnr, RESULTADO_OK);
+            atomic_store_explicit(&servidos[k]->estado, ESPERA_SERVIDA, memory_order_release);
+            acordarEspera(servidos[k]);
+            largarEspera(servidos[k]);
+        }
+    } while (n == LOTE_ENTREGA);
+}
+
+// Thread de um cliente que encontrou o voo cheio: entra na lista e espera
+// pelo lugar, no máximo PRAZO_ESPERA_LUGAR segundos
+void* esperaLugar_thread(void* arg) {
+    EsperaLugar *e = arg;
+    int p = e->particao;
+    ListaEspera *l = &listas_espera[p];
+    e->chegada_ns = instanteEsperaNs();
+
+    bloquearPNR(p);
+    if (!motorAtivo() || atomic_load(&l->profundidade) >= MAX_ESPERA_VOO) {
+        desbloquearPNR(p);
+        printf("Voo %d cheio e sem lugar na lista de espera.\n", p);
+        atomic_fetch_add(&l->recusadas, 1);
+        concluirPedido(e->id, (Resultado){ RESULTADO_CHEIO, PNR_INVALIDO });
+        free(e);
+        clienteSaiuDaEspera();
+        relogioSair();
+        return NULL;
+    }
+    e->na_lista = 1;
+    if (l->ultimo)
+        l->ultimo->prox = e;
+    else
+        l->primeiro = e;
+    l->ultimo = e;
+    int profundidade = atomic_fetch_add(&l->profundidade, 1) + 1;
+    if (profundidade > atomic_load(&l->profundidade_max))
+        atomic_store(&l->profundidade_max, profundidade); // com o mutex da partição
+    desbloquearPNR(p);
+    atomic_fetch_add(&l->entradas, 1);
+    printf("Voo %d cheio: cliente na lista de espera (%d à espera).\n", p, profundidade);
+
+    // Um lugar pode ter ficado livre entre a reserva falhada e a entrada na lista
+    entregarLugares(p);
+
+    int64_t prazo = e->chegada_ns + (int64_t)PRAZO_ESPERA_LUGAR * 1000000000;
+    unsigned estado;
+    while ((estado = atomic_load_explicit(&e->estado, memory_order_acquire)) == ESPERA_A_ESPERAR) {
+        int64_t falta_ns = prazo - instanteEsperaNs();
+        if (falta_ns > 0) {
+            if (relogio_virtual)
+                relogioDormirAte(relogioAgoraMs() + falta_ns / 1000000 + 1, continuarEspera, e);
+            else
+                futexEsperar(&e->estado, ESPERA_A_ESPERAR, falta_ns / 1000000 + 1);
+            continue;
+        }
+        // Desiste, a não ser que o lugar lhe esteja a ser entregue
+        bloquearPNR(p);
+        if (e->na_lista) {
+            EsperaLugar **pp = &l->primeiro, *anterior = NULL;
+            while (*pp != e) {
+                anterior = *pp;
+                pp = &(*pp)->prox;
+            }
+            *pp = e->prox;
+            if (l->ultimo == e)
+                l->ultimo = anterior;
+            e->na_lista = 0;
+            atomic_fetch_sub(&l->profundidade, 1);
+            atomic_store(&e->estado, ESPERA_ENCERRADA);
+        }
+        desbloquearPNR(p);
+        prazo = INT64_MAX; // se estava a ser entregue, espera pela entrega
+    }
+
+    int64_t espera = instanteEsperaNs() - e->chegada_ns;
+    if (estado == ESPERA_SERVIDA) {
+        atomic_fetch_add(&l->servidas, 1);
+        atomic_fetch_add(&l->espera_total_ns, espera);
+        long maximo = atomic_load(&l->espera_max_ns);
+        while (espera > maximo && !atomic_compare_exchange_weak(&l->espera_max_ns, &maximo, espera))
+            ;
+        registarRecente(e->pnr);
+        concluirPedido(e->id, (Resultado){ RESULTADO_OK, e->pnr });
+        printf("Lugar da lista de espera entregue: PNR %s (voo %d, %.1f ms à espera)\n", textoPNR(e->pnr).texto, p, espera / 1e6);
+    } else {
+        atomic_fetch_add(&l->desistencias, 1);
+        concluirPedido(e->id, (Resultado){ RESULTADO_CHEIO, PNR_INVALIDO });
+        printf("Cliente desistiu da lista de espera do voo %d ao fim de %.1f s.\n", p, espera / 1e9);
+    }
+    largarEspera(e);
+    clienteSaiuDaEspera();
+    relogioSair();
+    return NULL;
+}
+
+// O cliente da reserva id, recusada por falta de lugar no voo p, passa à
+// lista de espera; o pedido fica em espera até o cliente sair dela
+void esperarLugar(int p, uint64_t id) {
+    pthread_t t;
+    pthread_attr_t attr;
+    EsperaLugar *e = calloc(1, sizeof(EsperaLugar));
+    if (!e) {
+        perror("Erro ao alocar memória");
+        atomic_fetch_add(&listas_espera[p].recusadas, 1);
+        concluirPedido(id, (Resultado){ RESULTADO_CHEIO, PNR_INVALIDO });
+        return;
+    }
+    atomic_init(&e->referencias, 1);
+    e->id = id;
+    e->particao = p;
+    concluirPedido(id, (Resultado){ RESULTADO_EM_ESPERA, PNR_INVALIDO });
+    atomic_fetch_add(&clientes_a_esperar, 1);
+    relogioParticipar();
+    atributosOperacao(&attr, p);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&t, &attr, esperaLugar_thread, e) != 0) {
+        free(e);
+        concluirPedido(id, (Resultado){ RESULTADO_CHEIO, PNR_INVALIDO });
+        clienteSaiuDaEspera();
+        relogioSair();
+    }
+    pthread_attr_destroy(&attr);
+}
+
+// Drenagem: tira todos os clientes das listas e espera que as suas threads
+// terminem
+void encerrarListasEspera() {
+    for (int p = 0; p < n_particoes; p++) {
+        ListaEspera *l = &listas_espera[p];
+        bloquearPNR(p);
+        EsperaLugar *e = l->primeiro;
+        l->primeiro = l->ultimo = NULL;
+        atomic_store(&l->profundidade, 0);
+        while (e) {
+            EsperaLugar *prox = e->prox;
+            e->na_lista = 0;
+            atomic_fetch_add_explicit(&e->referencias, 1, memory_order_relaxed);
+            atomic_store(&e->estado, ESPERA_ENCERRADA);
+            acordarEspera(e);
+            largarEspera(e);
+            e = prox;
+        }
+        desbloquearPNR(p);
+    }
+    unsigned restantes;
+    while ((restantes = atomic_load(&clientes_a_esperar)) > 0)
+        futexEsperar(&clientes_a_esperar, restantes, 100);
+}
+
+int clientesEmEspera(int p) {
+    return atomic_load(&listas_espera[p].profundidade);
+}
+
+void imprimirMetricasEspera() {
+    if (!lugares_por_voo)
+        return;
+    for (int p = 0; p < n_particoes; p++) {
+        ListaEspera *l = &listas_espera[p];
+        long servidas = atomic_load(&l->servidas);
+        printf("Lista de espera do voo %d: %d à espera (máx. %d) | %ld entrada(s), %ld recusada(s) com a lista cheia, "
+               "%ld servida(s), %ld desistência(s) | espera média %.1f ms, máx. %.1f ms\n",
+               p, atomic_load(&l->profundidade), atomic_load(&l->profundidade_max), atomic_load(&l->entradas),
+               atomic_load(&l->recusadas), servidas, atomic_load(&l->desistencias),
+               servidas ? atomic_load(&l->espera_total_ns) / 1e6 / servidas : 0.0,
+               atomic_load(&l->espera_max_ns) / 1e6);
+    }
+}
+
+// Ceifeiro das reservas expiradas. Retira-as por lotes: cada lote leva no
+// máximo lote_expiracao reservas e segura a partição no máximo
+// max_bloqueio_us; a saída do índice e as mensagens ficam para depois de
+// largar o bloqueio.
+#define LOTE_EXPIRACAO 256
+#define MAX_BLOQUEIO_US 500
+
+typedef struct {
+    uint32_t pnr;
+    int64_t timestamp;
+} Expirada;
+
+typedef struct {
+    int n;
+    Expirada expiradas[];
+} LoteExpirado;
+
+// Seguimento de um lote do ceifeiro, já fora do bloqueio: retira as reservas
+// do índice e avisa que expiraram. A chave (prazo, PNR) não pode ter sido
+// reutilizada: uma nova reserva com o mesmo PNR tem prazo posterior.
+void notificarLote(const Expirada *expiradas, int n) {
+    for (int j = 0; j < n; j++) {
+        indiceRemover(expiradas[j].timestamp + PRAZO_PAGAMENTO, expiradas[j].pnr);
+        printf("PNR: %s não foi pago e foi removido.\n", textoPNR(expiradas[j].pnr).texto);  // Exibe a reserva removida
+    }
+}
+
+// Tarefa do executor com uma cópia do lote
+void* notificarExpiradas(void* arg) {
+    LoteExpirado *lote = arg;
+    notificarLote(lote->expiradas, lote->n);
+    free(lote);
+    return NULL;
+}
+
+int lote_expiracao = LOTE_EXPIRACAO;
+atomic_int ceifeiro_em_pausa = 0; // durante a reprodução de um registo
+long max_bloqueio_us = MAX_BLOQUEIO_US;
+atomic_long expiradas_total = 0, lotes_expiracao = 0, bloqueio_max_ns = 0;
+
+// Conta por partição as reservas por pagar já fora de prazo
+void contarExpiradas(int64_t prazo, uint32_t pnr, int pago, void *ctx) {
+    (void)prazo;
+    if (!pago)
+        ((int*)ctx)[particaoDoPNR(pnr)]++;
+}
+
+// Retira da partição p, lote a lote, as reservas por pagar há
+// PRAZO_PAGAMENTO segundos ou mais. Retorna quantas retirou.
+int ceifarParticao(int p, time_t agora, Expirada *lote) {
+    int total = 0;
+    int k = INT32_MAX; // posição seguinte a ver no vetor denso
+    while (k >= 0) {
+        ArmazemPNR *a = bloquearPNR(p);
+        int64_t inicio = agoraNs();
+        int64_t limite = inicio + max_bloqueio_us * 1000;
+        int n = 0, vistos = 0;
+
+        // Percorre de trás para a frente: a remoção traz para a posição k uma
+        // reserva que já foi vista. Entre lotes as outras operações só
+        // acrescentam no fim ou movem para trás a última reserva, por isso as
+        // que faltam ver continuam em [0, k].
+        if (k > a->n_reservas - 1)
+            k = a->n_reservas - 1;
+        for (; k >= 0 && n < lote_expiracao; k--) {
+            if (++vistos % 64 == 0 && agoraNs() > limite)
+                break;
+            int32_t atual = DENSOS(a)[k];
+            if (!pagoDe(NO(a, atual)) && agora >= prazoDe(NO(a, atual))) {
+                lote[n].pnr = NO(a, atual)->pnr;
+                lote[n].timestamp = momentoDe(NO(a, atual));
+                n++;
+                // O evento é emitido com a partição bloqueada para manter a ordem
+                emitirEvento(EVENTO_EXPIRACAO, NO(a, atual)->pnr, lote[n - 1].timestamp, 0);
+                desligarNo(a, atual);
+            }
+        }
+        int64_t segurado = agoraNs() - inicio;
+        desbloquearPNR(p);
+        for (int j = 0; j < n; j++)
+            gravarTraco(OP_EXPIRAR, lote[j].pnr, RESULTADO_OK);
+        if (n > 0)
+            entregarLugares(p);
+
+        long maximo = atomic_load(&bloqueio_max_ns);
+        while (segurado > maximo && !atomic_compare_exchange_weak(&bloqueio_max_ns, &maximo, segurado))
+            ;
+        atomic_fetch_add(&lotes_expiracao, 1);
+
+        // O resto é feito fora do bloqueio, pelo trabalhador da partição se o
+        // executor estiver a correr; sem executor ou sem memória para a cópia
+        // do lote, aqui mesmo
+        if (n > 0) {
+            LoteExpirado *notificacao = executor ? malloc(sizeof(LoteExpirado) + n * sizeof(Expirada)) : NULL;
+            if (notificacao) {
+                notificacao->n = n;
+                memcpy(notificacao->expiradas, lote, n * sizeof(Expirada));
+                if (executorSubmeter(executor, trabalhadorDaParticao(p), notificarExpiradas, notificacao) != 0)
+                    notificarExpiradas(notificacao);
+            } else
+                notificarLote(lote, n);
+        }
+        total += n;
+    }
+    atomic_fetch_add(&expiradas_total, total);
+    return total;
+}
+
+// Passagem do ceifeiro por todas as partições. Com o índice ativo só visita
+// as partições onde ele indica reservas expiradas.
+void expirarTodas() {
+    time_t agora = relogioAgora();
+    int expiradas[MAX_PARTICOES];
+    Expirada *lote = malloc(lote_expiracao * sizeof(Expirada));
+    if (!lote)
+        return;
+    for (int p = 0; p < n_particoes; p++)
+        expiradas[p] = !indice_ativo;
+    indiceIntervalo(INT64_MIN, agora, contarExpiradas, expiradas);
+    for (int p = 0; p < n_particoes; p++) {
+        if (expiradas[p])
+            ceifarParticao(p, agora, lote);
+    }
+    free(lote);
 }
 
-// Função que seleciona um nó aleatório (sem removê-lo) e retorna seu PNR.
-int obterReservaAleatoria(int *pnr) {
-    if (meuPNR == NULL)
+// Expira já o PNR indicado, se ainda estiver por pagar (na reprodução de um
+// registo). Retorna 1 se o expirou, com o seu prazo em *prazo.
+int expirarPNR(uint32_t pnr, time_t *prazo) {
+    int p = particaoDoPNR(pnr);
+    ArmazemPNR *a = bloquearPNR(p);
+    int32_t i = procurarReserva(a, pnr);
+    Expirada expirada;
+    int expirou = 0;
+    if (i != NENHUM && !pagoDe(NO(a, i))) {
+        expirada = (Expirada){ pnr, momentoDe(NO(a, i)) };
+        *prazo = prazoDe(NO(a, i));
+        emitirEvento(EVENTO_EXPIRACAO, pnr, expirada.timestamp, 0);
+        desligarNo(a, i);
+        expirou = 1;
+    }
+    desbloquearPNR(p);
+    if (!expirou)
         return 0;
-    int count = 0;
-    PNRNode *temp = meuPNR;
-    while (temp) {
-        count++;
-        temp = temp->next;
-    }
-    int index = rand() % count;
-    temp = meuPNR;
-    for (int i = 0; i < index; i++) {
-        temp = temp->next;
-    }
-    *pnr = temp->pnr;
+    gravarTraco(OP_EXPIRAR, pnr, RESULTADO_OK);
+    entregarLugares(p);
+    notificarLote(&expirada, 1);
+    atomic_fetch_add(&expiradas_total, 1);
     return 1;
 }
 
-// Função para exibir todas as reservas atuais
-void imprimirReservas() {
-    pthread_mutex_lock(&meuPNR_mutex);
-    printf("\n=== Reservas Atuais ===\n");
-    PNRNode *temp = meuPNR;
-    while (temp) {
-        printf("PNR: %d\n", temp->pnr);
-        temp = temp->next;
+void imprimirMetricasExpiracao() {
+    printf("Expiração: %ld reserva(s) em %ld lote(s), bloqueio máximo %.1f us (limite %ld us)\n",
+           atomic_load(&expiradas_total), atomic_load(&lotes_expiracao),
+           atomic_load(&bloqueio_max_ns) / 1000.0, max_bloqueio_us);
+}
+
+// ===================== Pedidos dos clientes externos =====================
+// Executados pelos trabalhadores para o servidor de pedidos (servidor.h) e pela
+// reprodução de um registo. Os clientes da rede não entram na lista de espera
+// dos voos: com o voo cheio, ou com alguém já à espera, a reserva recebe logo
+// RESULTADO_CHEIO.
+// Reserva o PNR indicado ou, com 0, um PNR novo numa partição ao acaso
+Resultado reservarRede(uint32_t pnr) {
+    if (pnr >= LIMITE_PNR)
+        return (Resultado){ RESULTADO_INVALIDO, pnr };
+    int p = pnr != 0 ? particaoDoPNR(pnr) : (int)aleatorio(n_particoes);
+    ArmazemPNR *a = bloquearPNR(p);
+    if (vooCheio(a, p))
+        pnr = PNR_INVALIDO; // os clientes da rede não esperam: recebem CHEIO
+    else if (pnr == 0)
+        pnr = adicionarReserva(a, p);
+    else if (procurarReserva(a, pnr) != NENHUM) {
+        desbloquearPNR(p);
+        return (Resultado){ RESULTADO_INVALIDO, pnr };
+    } else
+        pnr = registarReserva(a, pnr);
+    desbloquearPNR(p);
+    if (pnr == PNR_INVALIDO)
+        return (Resultado){ RESULTADO_CHEIO, PNR_INVALIDO };
+    registarRecente(pnr);
+    return (Resultado){ RESULTADO_OK, pnr };
+}
+
+// Paga ou cancela o PNR indicado
+Resultado alterarPNR(int op, uint32_t pnr) {
+    int p = particaoDoPNR(pnr);
+    ArmazemPNR *a = bloquearPNR(p);
+    int32_t i = procurarReserva(a, pnr);
+    Resultado res = { RESULTADO_OK, pnr };
+    if (i == NENHUM) {
+        res.codigo = RESULTADO_INEXISTENTE;
+    } else if (op == OP_CANCELAR) {
+        libertarNo(a, i);
+        emitirEvento(EVENTO_CANCELAMENTO, pnr, 0, 0);
+        printf("Reserva cancelada: %s\n", textoPNR(pnr).texto);
+    } else if (pagoDe(NO(a, i))) {
+        res.codigo = RESULTADO_JA_PAGO;
+    } else {
+        marcarPago(a, i);
+        emitirEvento(EVENTO_PAGAMENTO, pnr, momentoDe(NO(a, i)), 1);
+        printf("Pagamento feito com sucesso: PNR %s\n", textoPNR(pnr).texto);
     }
-    pthread_mutex_unlock(&meuPNR_mutex);
+    desbloquearPNR(p);
+    return res;
 }
 
+// Executa um pedido de um cliente externo ou da reprodução de um registo;
+// nas consultas devolve também o prazo em *prazo
+Resultado executarPedido(int op, uint64_t id, uint32_t pnr, time_t *prazo_consulta) {
+    Resultado res = { RESULTADO_INVALIDO, pnr };
+    time_t prazo = 0;
+    static const int CLASSES[] = { 0, CLASSE_RESERVA, CLASSE_CONSULTA, CLASSE_PAGAMENTO, CLASSE_CANCELAMENTO };
+
+    if (op < OP_RESERVAR || op > OP_CANCELAR) {
+        // fica RESULTADO_INVALIDO
+    } else if (!admitirOperacao()) {
+        res.codigo = RESULTADO_RECUSADO;
+    } else if (op == OP_CONSULTAR) {
+        entrarEscalonador(CLASSE_CONSULTA, relogioAgoraMs());
+        int da_cache;
+        int estado = consultarPNR(pnr, &prazo, &da_cache);
+        res.codigo = estado == ESTADO_INEXISTENTE ? RESULTADO_INEXISTENTE
+                   : estado == ESTADO_PAGO ? RESULTADO_JA_PAGO : RESULTADO_OK;
+        gravarTraco(op, pnr, res.codigo);
+        sairEscalonador();
+        terminarOperacao();
+    } else {
+        // Uma repetição responde-se da tabela, sem ocupar uma vaga
+        if (iniciarPedido(id, &res)) {
+            // Os pagamentos entram no escalonador com o prazo da sua reserva,
+            // se estiver na cache de consultas; senão, pela ordem de chegada
+            int64_t chave = relogioAgoraMs();
+            time_t prazo_pago;
+            if (op == OP_PAGAR && espreitarPrazo(pnr, &prazo_pago))
+                chave = (int64_t)prazo_pago * 1000;
+            entrarEscalonador(CLASSES[op], chave);
+            res = op == OP_RESERVAR ? reservarRede(pnr) : alterarPNR(op, pnr);
+            concluirPedido(id, res);
+            gravarTraco(op, res.pnr, res.codigo);
+            if (op == OP_CANCELAR && res.codigo == RESULTADO_OK)
+                entregarLugares(particaoDoPNR(pnr));
+            sairEscalonador();
+        }
+        terminarOperacao();
+    }
+    *prazo_consulta = prazo;
+    return res;
+}
 // Thread que exibe o conteúdo da variável meuPNR a cada 30 segundos
 void* impressao_thread(void* arg) {
-    while (1) {
-        sleep(30); // Alterado para 30 segundos
-        pthread_mutex_lock(&meuPNR_mutex);
+    while (esperarOuDrenar(30)) { // Alterado para 30 segundos
         printf("\n\n=== Reservas Atuais (a cada 30 segundos) ===\n\n");
-        PNRNode *temp = meuPNR;
-        while (temp) {
-            printf("PNR: %d\n", temp->pnr);
-            temp = temp->next;
+        for (int p = 0; p < n_particoes; p++) {
+            ArmazemPNR *a = bloquearPNR(p);
+            for (int k = 0; k < a->n_reservas; k++)
+                printf("PNR: %s\n", textoPNR(NO(a, DENSOS(a)[k])->pnr).texto);
+            desbloquearPNR(p);
         }
-        pthread_mutex_unlock(&meuPNR_mutex);
+        imprimirMetricasReplicacao();
+        imprimirMetricasExpiracao();
+        imprimirMetricasDedup();
+        imprimirMetricasConsultas();
+        imprimirMetricasEscalonador();
+        imprimirMetricasExecutor();
+        imprimirMetricasServidor();
+        imprimirMetricasCDC();
+        imprimirMetricasEspera();
+        imprimirPerfilTrincos();
+        imprimirColocacao();
+        relatorioPrazos();
     }
+    relogioSair();
     return NULL;
 }
 
-// Função de reserva (adiciona um novo PNR)
+// Função de reserva (adiciona um novo PNR à partição do pedido em arg)
 void* reserva_func(void* arg) {
-    sem_wait(&sem_reserva);
-    pthread_mutex_lock(&meuPNR_mutex);
-    adicionarReserva();
-    pthread_mutex_unlock(&meuPNR_mutex);
-    sem_post(&sem_reserva);
+    Pedido pedido = *(Pedido*)arg;
+    free(arg);
+    if (!admitirOperacao()) {
+        printf("Motor em drenagem: reserva recusada.\n");
+        return NULL;
+    }
+    Resultado res;
+    if (!iniciarPedido(pedido.id, &res)) {
+        if (res.codigo == RESULTADO_RECUSADO)
+            printf("Pedido %llu recusado: a tabela de pedidos está cheia.\n", (unsigned long long)pedido.id);
+        else if (res.codigo == RESULTADO_OK)
+            printf("Pedido %llu repetido: reserva %s já realizada.\n", (unsigned long long)pedido.id, textoPNR(res.pnr).texto);
+        else if (res.codigo == RESULTADO_EM_ESPERA)
+            printf("Pedido %llu repetido: o cliente está na lista de espera.\n", (unsigned long long)pedido.id);
+        else
+            printf("Pedido %llu repetido: a reserva tinha falhado.\n", (unsigned long long)pedido.id);
+        terminarOperacao();
+        return NULL;
+    }
+    entrarEscalonador(CLASSE_RESERVA, relogioAgoraMs());
+    ArmazemPNR *a = bloquearPNR(pedido.particao);
+    res.pnr = vooCheio(a, pedido.particao) ? PNR_INVALIDO : adicionarReserva(a, pedido.particao);
+    res.codigo = res.pnr == PNR_INVALIDO ? RESULTADO_CHEIO : RESULTADO_OK;
+    desbloquearPNR(pedido.particao);
+    if (res.codigo == RESULTADO_OK)
+        registarRecente(res.pnr);
+    // Sem lugar o cliente passa à lista de espera, que conclui o pedido
+    int em_espera = res.codigo == RESULTADO_CHEIO && lugares_por_voo;
+    if (!em_espera)
+        concluirPedido(pedido.id, res);
+    gravarTraco(OP_RESERVAR, res.pnr, res.codigo);
+    if (em_espera)
+        esperarLugar(pedido.particao, pedido.id);
+    sairEscalonador();
+    terminarOperacao();
     return NULL;
 }
 
-// Função de cancelamento (remove um PNR aleatório)
+// Função de cancelamento (remove um PNR aleatório da partição do pedido em arg)
 void* cancelamento_func(void* arg) {
-    sem_wait(&sem_cancelamento);
-    pthread_mutex_lock(&meuPNR_mutex);
-    int pnrRemovido;
-    if (removerReservaAleatoria(&pnrRemovido))
-        printf("Reserva cancelada: %d\n", pnrRemovido);
-    else
+    Pedido pedido = *(Pedido*)arg;
+    free(arg);
+    if (!admitirOperacao()) {
+        printf("Motor em drenagem: cancelamento recusado.\n");
+        return NULL;
+    }
+    Resultado res;
+    if (!iniciarPedido(pedido.id, &res)) {
+        if (res.codigo == RESULTADO_RECUSADO)
+            printf("Pedido %llu recusado: a tabela de pedidos está cheia.\n", (unsigned long long)pedido.id);
+        else if (res.codigo == RESULTADO_OK)
+            printf("Pedido %llu repetido: reserva %s já cancelada.\n", (unsigned long long)pedido.id, textoPNR(res.pnr).texto);
+        else
+            printf("Pedido %llu repetido: não havia reserva para cancelar.\n", (unsigned long long)pedido.id);
+        terminarOperacao();
+        return NULL;
+    }
+    entrarEscalonador(CLASSE_CANCELAMENTO, relogioAgoraMs());
+    ArmazemPNR *a = bloquearPNR(pedido.particao);
+    uint32_t pnrRemovido;
+    if (removerReservaAleatoria(a, &pnrRemovido)) {
+        emitirEvento(EVENTO_CANCELAMENTO, pnrRemovido, 0, 0);
+        printf("Reserva cancelada: %s\n", textoPNR(pnrRemovido).texto);
+        res = (Resultado){ RESULTADO_OK, pnrRemovido };
+    }
+    else {
         printf("Nenhuma reserva para cancelar.\n");
-    pthread_mutex_unlock(&meuPNR_mutex);
-    sem_post(&sem_cancelamento);
+        res = (Resultado){ RESULTADO_VAZIO, PNR_INVALIDO };
+    }
+    desbloquearPNR(pedido.particao);
+    concluirPedido(pedido.id, res);
+    gravarTraco(OP_CANCELAR, res.pnr, res.codigo);
+    if (res.codigo == RESULTADO_OK)
+        entregarLugares(pedido.particao);
+    sairEscalonador();
+    terminarOperacao();
     return NULL;
 }
 
-// Função de consulta (seleciona um PNR aleatório sem removê-lo)
+// Função de consulta: consulta o PNR do pedido em arg (pela cache) ou, se o
+// pedido não indica nenhum, seleciona um PNR aleatório da partição sem removê-lo
 void* consulta_func(void* arg) {
-    sem_wait(&sem_consulta);
-    pthread_mutex_lock(&meuPNR_mutex);
-    int pnr;
-    if (obterReservaAleatoria(&pnr))
-        printf("Consulta feita com sucesso: %d\n", pnr);
-    else
+    Pedido pedido = *(Pedido*)arg;
+    free(arg);
+    if (!admitirOperacao()) {
+        printf("Motor em drenagem: consulta recusada.\n");
+        return NULL;
+    }
+    entrarEscalonador(CLASSE_CONSULTA, relogioAgoraMs());
+    if (pedido.pnr != PNR_INVALIDO) {
+        time_t prazo;
+        int da_cache;
+        int estado = consultarPNR(pedido.pnr, &prazo, &da_cache);
+        if (estado == ESTADO_INEXISTENTE)
+            printf("Consulta: PNR %s não existe%s.\n", textoPNR(pedido.pnr).texto, da_cache ? " (cache)" : "");
+        else
+            printf("Consulta feita com sucesso: %s, %s%s\n", textoPNR(pedido.pnr).texto,
+                   estado == ESTADO_PAGO ? "pago" : "por pagar", da_cache ? " (cache)" : "");
+        gravarTraco(OP_CONSULTAR, pedido.pnr, estado == ESTADO_INEXISTENTE ? RESULTADO_INEXISTENTE
+                                            : estado == ESTADO_PAGO ? RESULTADO_JA_PAGO : RESULTADO_OK);
+    } else {
+        ArmazemPNR *a = bloquearPNR(pedido.particao);
+        uint32_t pnr;
+        int codigo = RESULTADO_VAZIO;
+        if (obterReservaAleatoria(a, &pnr)) {
+            printf("Consulta feita com sucesso: %s\n", textoPNR(pnr).texto);
+            // Para o registo importa se estava paga (só se procura com --gravar)
+            codigo = ficheiro_traco && pagoDe(NO(a, procurarReserva(a, pnr))) ? RESULTADO_JA_PAGO : RESULTADO_OK;
+        } else {
+            printf("Nenhuma reserva para consultar.\n");
+            pnr = PNR_INVALIDO;
+        }
+        desbloquearPNR(pedido.particao);
+        gravarTraco(OP_CONSULTAR, pnr, codigo);
+    }
+    sairEscalonador();
+    terminarOperacao();
+    return NULL;
+}
+
+// Consulta em lote: k reservas distintas escolhidas uniformemente em todo o
+// armazenamento (k indicado em arg, no máximo MAX_LOTE_CONSULTA)
+#define MAX_LOTE_CONSULTA 32
+void* consulta_lote_func(void* arg) {
+    int k = (intptr_t)arg;
+    uint32_t pnrs[MAX_LOTE_CONSULTA];
+    if (!admitirOperacao()) {
+        printf("Motor em drenagem: consulta recusada.\n");
+        return NULL;
+    }
+    entrarEscalonador(CLASSE_CONSULTA, relogioAgoraMs());
+    int n = amostrarReservas(k < MAX_LOTE_CONSULTA ? k : MAX_LOTE_CONSULTA, pnrs);
+    if (n == 0) {
         printf("Nenhuma reserva para consultar.\n");
-    pthread_mutex_unlock(&meuPNR_mutex);
-    sem_post(&sem_consulta);
+    } else {
+        printf("Consulta em lote feita com sucesso:");
+        for (int j = 0; j < n; j++)
+            printf(" %s", textoPNR(pnrs[j]).texto);
+        printf("\n");
+    }
+    sairEscalonador();
+    terminarOperacao();
     return NULL;
 }
 
-// Função de pagamento (marca um PNR como pago)
+// PNR não pago com o prazo mais próximo da partição, ou NENHUM
+static int32_t porPagarMaisUrgente(ArmazemPNR *a) {
+    int32_t escolhido = NENHUM;
+    for (int j = 0; j < a->n_reservas; j++) {
+        int32_t temp = DENSOS(a)[j];
+        if (!pagoDe(NO(a, temp)) && (escolhido == NENHUM || prazoDe(NO(a, temp)) < prazoDe(NO(a, escolhido))))
+            escolhido = temp;
+    }
+    return escolhido;
+}
+
+static Resultado pagarNo(ArmazemPNR *a, int32_t i) {
+    marcarPago(a, i);
+    emitirEvento(EVENTO_PAGAMENTO, NO(a, i)->pnr, momentoDe(NO(a, i)), 1);
+    printf("Pagamento feito com sucesso: PNR %s\n", textoPNR(NO(a, i)->pnr).texto);
+    return (Resultado){ RESULTADO_OK, NO(a, i)->pnr };
+}
+
+// Função de pagamento (marca um PNR como pago). Começa pela partição do
+// pedido em arg e passa às seguintes se lá não houver nenhum PNR por pagar.
+// Uma repetição do mesmo pedido devolve o PNR pago da primeira vez em vez de
+// pagar outro.
 void* pagamento_func(void* arg) {
-    sem_wait(&sem_pagamento);
-    pthread_mutex_lock(&meuPNR_mutex);
-    
-    // Verifica se há reservas na lista
-    if (meuPNR == NULL) {
-        printf("Não há reservas para pagamento.\n");
-    } else {
-        PNRNode *temp = meuPNR;
-        
-        // Percorre a lista procurando um PNR não pago
-        while (temp) {
-            if (temp->pago == 0) {  // Se o PNR não foi pago
-                temp->pago = 1;  // Marca como pago
-                printf("Pagamento feito com sucesso: PNR %d\n", temp->pnr);
-                break;  // Para de procurar assim que encontrar o primeiro não pago
-            }
-            temp = temp->next;
+    Pedido pedido = *(Pedido*)arg;
+    free(arg);
+    int inicio = pedido.particao;
+    int vazio = 1, pago = 0;
+    if (!admitirOperacao()) {
+        printf("Motor em drenagem: pagamento recusado.\n");
+        return NULL;
+    }
+    Resultado res = { RESULTADO_VAZIO, PNR_INVALIDO };
+    if (!iniciarPedido(pedido.id, &res)) {
+        if (res.codigo == RESULTADO_RECUSADO)
+            printf("Pedido %llu recusado: a tabela de pedidos está cheia.\n", (unsigned long long)pedido.id);
+        else if (res.codigo == RESULTADO_OK)
+            printf("Pedido %llu repetido: PNR %s já tinha sido pago.\n", (unsigned long long)pedido.id, textoPNR(res.pnr).texto);
+        else
+            printf("Pedido %llu repetido: não havia PNR por pagar.\n", (unsigned long long)pedido.id);
+        terminarOperacao();
+        return NULL;
+    }
+    // Escolhe já o PNR a pagar (o por pagar mais urgente da primeira partição
+    // que tiver um) e entra no escalonador com o prazo dele
+    uint32_t alvo = PNR_INVALIDO;
+    int64_t chave = relogioAgoraMs();
+    for (int k = 0; k < n_particoes && alvo == PNR_INVALIDO; k++) {
+        int p = (inicio + k) % n_particoes;
+        ArmazemPNR *a = bloquearPNR(p);
+        int32_t i = porPagarMaisUrgente(a);
+        if (i != NENHUM) {
+            alvo = NO(a, i)->pnr;
+            chave = (int64_t)prazoDe(NO(a, i)) * 1000;
+        }
+        desbloquearPNR(p);
+    }
+    entrarEscalonador(CLASSE_PAGAMENTO, chave);
+
+    if (alvo != PNR_INVALIDO) {
+        int p = particaoDoPNR(alvo);
+        ArmazemPNR *a = bloquearPNR(p);
+        int32_t i = procurarReserva(a, alvo);
+        if (i != NENHUM && !pagoDe(NO(a, i))) {
+            res = pagarNo(a, i);
+            pago = 1;
+            vazio = 0;
         }
-        
-        if (temp == NULL) {
-            printf("Todos os PNRs já foram pagos.\n");
+        desbloquearPNR(p);
+    }
+    // Se o alvo foi pago ou saiu enquanto esperava pela vaga, paga o seguinte
+    for (int k = 0; k < n_particoes && !pago; k++) {
+        int p = (inicio + k) % n_particoes;
+        ArmazemPNR *a = bloquearPNR(p);
+        if (a->n_reservas > 0)
+            vazio = 0;
+        int32_t escolhido = porPagarMaisUrgente(a);
+        if (escolhido != NENHUM) {
+            res = pagarNo(a, escolhido);
+            pago = 1;
         }
+        desbloquearPNR(p);
+    }
+
+    if (vazio)
+        printf("Não há reservas para pagamento.\n");
+    else if (!pago) {
+        printf("Todos os PNRs já foram pagos.\n");
+        res.codigo = RESULTADO_TODOS_PAGOS;
     }
+    concluirPedido(pedido.id, res);
+    gravarTraco(OP_PAGAR, res.pnr, res.codigo);
 
-    pthread_mutex_unlock(&meuPNR_mutex);
-    sem_post(&sem_pagamento);
+    sairEscalonador();
+    terminarOperacao();
     return NULL;
 }
 
-// Thread que verifica a cada 5 segundos se algum PNR está pendente há 60 segundos.
-// Se estiver, remove-o e exibe a mensagem correspondente.
+// Thread ceifeira: a cada 5 segundos retira os PNRs pendentes há 60 segundos
+// e exibe a mensagem correspondente.
 void* verificador_timeout(void* arg) {
-    while (1) {
-        sleep(5);  // Aguarda 5 segundos antes de verificar novamente
-        pthread_mutex_lock(&meuPNR_mutex);
-        
-        time_t agora = time(NULL);
-        PNRNode *atual = meuPNR;
-        PNRNode *anterior = NULL;
-
-        while (atual) {
-            double diff = difftime(agora, atual->timestamp);
-            if (diff >= 60 && atual->pago == 0) {  // Se o PNR não foi pago após 1 minuto
-                int pnrComTimeout = atual->pnr;
-                
-                // Remove a reserva não paga da lista
-                if (anterior == NULL) {
-                    meuPNR = atual->next;  // Se for o primeiro elemento, ajusta o ponteiro da cabeça
-                    free(atual);
-                    atual = meuPNR;  // Avança para o próximo elemento
-                } else {
-                    anterior->next = atual->next;  // Remove o PNR da lista
-                    free(atual);
-                    atual = anterior->next;  // Avança para o próximo elemento
-                }
-
-                printf("PNR: %d não foi pago e foi removido.\n", pnrComTimeout);  // Exibe a reserva removida
-            } else {
-                anterior = atual;
-                atual = atual->next;
-            }
-        }
-        
-        pthread_mutex_unlock(&meuPNR_mutex);
+    while (esperarOuDrenar(5)) { // Aguarda 5 segundos antes de verificar novamente
+        if (!atomic_load(&ceifeiro_em_pausa))
+            expirarTodas();
+        atenderPedidoPerfil();
     }
+    relogioSair();
     return NULL;
 }
 
+// Drenagem: deixa de admitir operações, espera (no máximo PRAZO_DRENAGEM
+// segundos) pelas que estão em curso, pára as threads de fundo, faz uma
+// última passagem de expiração e envia os últimos eventos à réplica.
+// Retorna 1 se todas as operações terminaram.
+int drenarMotor(pthread_t timeoutThread, pthread_t printThread, pthread_t replicacaoThread) {
+    int ativo = MOTOR_ATIVO;
+    atomic_compare_exchange_strong(&estado_motor, &ativo, MOTOR_DRENANDO);
+    printf("\n=== Drenagem iniciada: %d operação(ões) em curso ===\n", atomic_load(&operacoes_em_curso));
 
-int main() {
-    srand(time(NULL));
-    pthread_mutex_init(&meuPNR_mutex, NULL);
-    sem_init(&sem_reserva, 0, 1);
-    sem_init(&sem_consulta, 0, 1);
-    sem_init(&sem_pagamento, 0, 1);
-    sem_init(&sem_cancelamento, 0, 1);
+    struct timespec prazo;
+    clock_gettime(CLOCK_REALTIME, &prazo);
+    prazo.tv_sec += PRAZO_DRENAGEM;
 
-    // Cria a thread que verifica os PNRs com timeout
-    pthread_t timeoutThread;
-    pthread_create(&timeoutThread, NULL, verificador_timeout, NULL);
+    pthread_mutex_lock(&drenagem_mutex);
+    while (atomic_load(&operacoes_em_curso) > 0) {
+        if (pthread_cond_timedwait(&drenagem_cond, &drenagem_mutex, &prazo) != 0)
+            break; // prazo da drenagem esgotado
+    }
+    atomic_store(&estado_motor, MOTOR_PARADO);
+    pthread_cond_broadcast(&drenagem_cond); // acorda timeout e impressão
+    pthread_mutex_unlock(&drenagem_mutex);
+    if (relogio_virtual)
+        relogioAcordar();
+
+    pthread_join(timeoutThread, NULL);
+    pthread_join(printThread, NULL);
+
+    int pendentes = atomic_load(&operacoes_em_curso);
+    if (pendentes > 0) {
+        printf("Drenagem: prazo de %d segundos esgotado com %d operação(ões) em curso.\n", PRAZO_DRENAGEM, pendentes);
+        fflush(stdout);
+        return 0;
+    }
+
+    // Os clientes ainda na lista de espera saem sem lugar
+    encerrarListasEspera();
+
+    // Última passagem de expiração (e as suas notificações) e estado final
+    expirarTodas();
+    executorEsperar(executor);
+    if (destino_replicacao)
+        pararReplicacao(replicacaoThread);
+    imprimirReservas();
+    imprimirMetricasReplicacao();
+    imprimirMetricasExpiracao();
+    imprimirMetricasDedup();
+    imprimirMetricasConsultas();
+    imprimirMetricasEscalonador();
+    imprimirMetricasExecutor();
+    imprimirMetricasServidor();
+    imprimirMetricasCDC();
+    imprimirMetricasEspera();
+    imprimirPerfilTrincos();
+    imprimirColocacao();
+    printf("=== Drenagem concluída ===\n");
+    fflush(stdout);
+    return 1;
+}
+
+// Modo réplica: recebe os eventos do primário e serve consultas localmente
+// SIGUSR2 na réplica pede a promoção a primário
+void pedirPromocao(int sinal) {
+    (void)sinal;
+    atomic_store(&pedido_promocao, 1);
+}
+
+// A réplica passa a primário se o pediram (SIGUSR2) ou se está sem primário
+// há pelo menos --promover-apos segundos
+int replicaDevePromover() {
+    if (atomic_exchange(&pedido_promocao, 0))
+        return 1;
+    int64_t desde = atomic_load(&sem_primario_desde_ms);
+    return promover_apos_s > 0 && desde != 0 && agoraMs() - desde >= promover_apos_s * 1000LL;
+}
+
+// Corre a réplica até à drenagem (retorna 0, ou 1 em erro) ou até ser
+// promovida (retorna REPLICA_PROMOVIDA, com a thread de impressão em
+// *printThread ainda a correr e o armazenamento aberto para o motor).
+int executarReplica(const char *endereco, pthread_t *printThread) {
+    fd_escuta_replica = abrirLigacao(endereco, 1);
+    if (fd_escuta_replica == -1) {
+        perror("Erro ao abrir o socket da réplica");
+        return 1;
+    }
+    printf("[Réplica] À espera do primário em %s.\n", endereco);
+    atomic_store(&sem_primario_desde_ms, agoraMs());
+
+    pthread_t receptorThread;
+    pthread_attr_t attr;
+    pthread_create(&receptorThread, NULL, receptor_replica, NULL);
+    atributosFixados(&attr, &cpus_impressao);
+    pthread_create(printThread, &attr, impressao_thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    // As consultas são servidas pela réplica, sem carga no primário
+    int promovida = 0;
+    while (!promovida && esperarOuDrenar(1)) {
+        consulta_lote_func((void*)(intptr_t)4);
+        promovida = replicaDevePromover();
+    }
 
-    // Cria a thread que exibe as reservas a cada 30 segundos
-    pthread_t printThread;
-    pthread_create(&printThread, NULL, impressao_thread, NULL);
+    // O receptor sai quando o socket de escuta deixa de aceitar ligações
+    if (!promovida) {
+        pthread_mutex_lock(&drenagem_mutex);
+        atomic_store(&estado_motor, MOTOR_PARADO);
+        pthread_cond_broadcast(&drenagem_cond);
+        pthread_mutex_unlock(&drenagem_mutex);
+    }
+    shutdown(fd_escuta_replica, SHUT_RDWR);
+    if (fd_ligacao_replica != -1)
+        shutdown(fd_ligacao_replica, SHUT_RDWR);
+    pthread_join(receptorThread, NULL);
+    close(fd_escuta_replica);
+    if (strncmp(endereco, "tcp:", 4) != 0)
+        unlink(endereco);
 
-    // As primeiras 8 operações serão de reserva
-    pthread_t threads[20];
-    for (int i = 0; i < 20; i++) {
-        pthread_create(&threads[i], NULL, reserva_func, NULL);
-        pthread_join(threads[i], NULL);
+    imprimirMetricasReplicacao();
+    if (promovida) {
+        printf("[Réplica] Promovida a primário (seq aplicado: %lu).\n", atomic_load(&seq_aplicado));
+        return REPLICA_PROMOVIDA;
     }
+    pthread_join(*printThread, NULL);
+    fecharArmazem();
+    return 0;
+}
 
-    //criando threads para pagamentos
-    pthread_t threads_pagamentos[10];
-    for(int i = 0; i < 10; i++)
-    {
-       pthread_create(&threads_pagamentos[i], NULL, pagamento_func, NULL);
-        pthread_join(threads_pagamentos[i], NULL);
+// Submete um pedido ao executor, pela fila do trabalhador da sua partição;
+// sem executor (ou sem memória para a tarefa) executa-o já, nesta thread.
+// Retorna -1 se não houve memória para o pedido (perde-se, como um cliente
+// que não chegou a ser atendido).
+int submeterPedido(void* (*func)(void*), Pedido pedido) {
+    Pedido *copia = malloc(sizeof(Pedido));
+    if (!copia) {
+        perror("Erro ao alocar memória");
+        return -1;
     }
+    *copia = pedido;
+    if (executorSubmeter(executor, trabalhadorDaParticao(pedido.particao), func, copia) != 0)
+        func(copia);
+    return 0;
+}
+
+// Submete o pedido id sobre a partição p
+int submeterOperacao(void* (*func)(void*), int p, uint64_t id) {
+    return submeterPedido(func, (Pedido){ id, p, PNR_INVALIDO });
+}
+
+// Clientes simulados: 20 reservas e 10 pagamentos e depois operações ao acaso
+// até à drenagem (ou até fim_simulacao, em simulação). Cada lote de pedidos é
+// submetido de uma vez e o main espera uma só vez que acabe.
+void simularClientes(time_t fim_simulacao, long intervalo_ms) {
+    // IDs dos pedidos dos clientes simulados
+    uint64_t proximo_pedido = 1;
+
+    // As primeiras 20 operações serão de reserva, num só lote
+    for (int i = 0; i < 20; i++)
+        submeterOperacao(reserva_func, i % n_particoes, proximo_pedido++);
+    executorEsperar(executor);
+
+    // Os pagamentos só depois das reservas, também num lote
+    for (int i = 0; i < 10; i++)
+        submeterOperacao(pagamento_func, escolherParticao(), proximo_pedido++);
+    executorEsperar(executor);
     
     // Exibe inicialmente o conteúdo da variável meuPNR
     imprimirReservas();
     // Loop alternado entre reserva, pagamento, consulta e cancelamento
-    while (1) {
-        int op = rand() % 4; // 0: reserva, 1: pagamento, 2: consulta, 3: cancelamento
-        pthread_t opThread;
+    while (atomic_load(&estado_motor) == MOTOR_ATIVO) {
+        int op = aleatorio(4); // 0: reserva, 1: pagamento, 2: consulta, 3: cancelamento
+        void* (*func)(void*) = NULL;
+        int p = 0;
         switch(op) {
             case 0:
+                func = reserva_func;
                 for(int i = 0; i <= 3; i++)
-                   pthread_create(&opThread, NULL, reserva_func, NULL);
+                   submeterOperacao(func, p = aleatorio(n_particoes), proximo_pedido++);
                 break;
             case 1:
-                   pthread_create(&opThread, NULL, pagamento_func, NULL);
+                   submeterOperacao(func = pagamento_func, p = escolherParticao(), proximo_pedido++);
                 break;
-            case 2:
-                pthread_create(&opThread, NULL, consulta_func, NULL);
+            case 2: {
+                // Em geral o cliente consulta um PNR reservado há pouco
+                uint32_t pnr = atomic_load(&pnrs_recentes[aleatorio(N_RECENTES)]);
+                if (pnr != 0)
+                    submeterPedido(consulta_func, (Pedido){ 0, particaoDoPNR(pnr), pnr });
+                else
+                    submeterOperacao(consulta_func, escolherParticao(), 0);
                 break;
+            }
             case 3:
-                pthread_create(&opThread, NULL, cancelamento_func, NULL);
+                submeterOperacao(func = cancelamento_func, p = escolherParticao(), proximo_pedido++);
                 break;
         }
-        pthread_join(opThread, NULL);
+
+        // De vez em quando o cliente não recebe a resposta a tempo e repete o
+        // último pedido com o mesmo ID; vai no mesmo lote (a tabela de pedidos
+        // põe a repetição à espera do original)
+        if (func && aleatorio(8) == 0)
+            submeterOperacao(func, p, proximo_pedido - 1);
+        executorEsperar(executor);
 
         // Intervalo entre operações
-        sleep(1);
+        relogioDormir(intervalo_ms);
+        if (fim_simulacao && relogioAgora() >= fim_simulacao)
+            pedirDrenagem(0);
+    }
+}
+
+// Reprodução de um registo gravado com --gravar: dá ao motor, pela ordem dos
+// instantes, as mesmas reservas, consultas, pagamentos e cancelamentos sobre os
+// mesmos PNRs e compara os resultados com os gravados. Na velocidade original
+// espera entre operações o tempo que passou na gravação, no relógio do motor
+// (em simulação é tempo virtual, e então também as expirações se repetem); com
+// velocidade_maxima não espera. A thread ceifeira fica parada e as
+// expirações fazem-se onde estão no registo, sobre os mesmos PNRs (a ordem
+// entre o ceifeiro e as operações no mesmo instante não se repetiria);
+// contam-se as que na reprodução ainda não tinham chegado ao prazo. As
+// operações gravadas sem PNR (não havia nada para pagar, cancelar ou
+// consultar) ficam de fora.
+#define MAX_DIFERENCAS_MOSTRADAS 10
+
+void reproduzirTraco(const RegistoTraco *registos, long n, int velocidade_maxima) {
+    long feitas = 0, diferentes = 0, ignoradas = 0;
+    long expiracoes = 0, nao_expiradas = 0, antes_do_prazo = 0;
+    int64_t inicio = agoraNs();
+    iniciarInstantes();
+    for (long i = 0; i < n && motorAtivo(); i++) {
+        const RegistoTraco *r = &registos[i];
+        if (r->pnr == PNR_INVALIDO || r->op < OP_RESERVAR || r->op > OP_EXPIRAR) {
+            ignoradas++;
+            continue;
+        }
+        if (!velocidade_maxima) {
+            int64_t falta_us = r->instante_us - instanteTraco();
+            if (falta_us > 0)
+                relogioDormir((falta_us + 999) / 1000);
+        }
+        time_t prazo;
+        if (r->op == OP_EXPIRAR) {
+            expiracoes++;
+            if (!expirarPNR(r->pnr, &prazo)) {
+                if (++nao_expiradas + diferentes <= MAX_DIFERENCAS_MOSTRADAS)
+                    printf("Reprodução: PNR %s já não estava por pagar aos %.3f s\n", textoPNR(r->pnr).texto, r->instante_us / 1e6);
+            } else if (!velocidade_maxima && prazo > relogioAgora()) {
+                antes_do_prazo++;
+            }
+            continue;
+        }
+        Resultado res = executarPedido(r->op, 0, r->pnr, &prazo);
+        feitas++;
+        if (res.codigo != r->resultado && ++diferentes + nao_expiradas <= MAX_DIFERENCAS_MOSTRADAS)
+            printf("Reprodução: %s do PNR %s aos %.3f s deu %d, gravado %d\n", NOMES_OPS[r->op],
+                   textoPNR(r->pnr).texto, r->instante_us / 1e6, res.codigo, r->resultado);
+    }
+    double segundos = (agoraNs() - inicio) / 1e9;
+    printf("Reprodução: %ld operação(ões) em %.2f s (%.0f op/s), %ld com resultado diferente do gravado, "
+           "%ld sem PNR ignorada(s)\n", feitas, segundos, segundos > 0 ? feitas / segundos : 0.0,
+           diferentes, ignoradas);
+    printf("Reprodução: %ld expiração(ões), %ld de PNRs que já não estavam por pagar, %ld antes do prazo\n",
+           expiracoes, nao_expiradas, antes_do_prazo);
+}
+
+// Os testes (make test) ligam-se ao motor compilado com -DTESTES e trazem o
+// seu próprio main
+#ifndef TESTES
+
+// Uso: Projeto [--primario DESTINO | --replica DESTINO] [--shm NOME] [--particoes N]
+//              [--cpus-operacoes LISTA] [--cpus-expiracao LISTA] [--cpus-impressao LISTA]
+//              [--lote-expiracao N] [--max-bloqueio-us N] [--semente N] [--vagas N]
+//              [--trabalhadores N] [--bench-executor] [--servir DESTINO]... [--carga DESTINO N]
+//              [--pedir DESTINO OP PNR] [--simular HORAS] [--intervalo-ms N] [--gravar FICHEIRO]
+//              [--reproduzir FICHEIRO [--velocidade-maxima]] [--cdc NOME] [--cdc-ler NOME]
+//              [--lugares N] [--trinco-justo] [--promover-apos S] [--taxa-pedidos N]
+// DESTINO é o caminho de um socket Unix ou "tcp:PORTA" (localhost).
+// --promover-apos S: a réplica sem primário há S segundos passa a primário
+// (SIGUSR2 promove-a logo); com --primario DESTINO replica então para DESTINO.
+// --servir abre o servidor de pedidos nesse destino (pode repetir-se); --carga
+// não arranca o motor: é um cliente que envia N pedidos ao servidor em DESTINO;
+// --pedir também não: envia-lhe um pedido (OP reserva|consulta|pagamento|cancelamento)
+// sobre o PNR em texto, ou "-" numa reserva para o servidor escolher.
+// --simular HORAS corre o motor em tempo virtual e drena-o ao fim dessas horas;
+// --intervalo-ms é a pausa entre operações do ciclo principal (1000 por omissão;
+// em simulação, no mínimo PAUSA_MINIMA_VIRTUAL_MS de tempo virtual).
+// --gravar guarda num ficheiro binário todas as operações e expirações;
+// --reproduzir dá ao motor as operações de um desses ficheiros, em vez dos
+// clientes simulados, com os intervalos gravados ou sem esperas.
+// --cdc NOME (ex.: /taag-cdc) publica os eventos das reservas nesse segmento
+// POSIX; --cdc-ler NOME não arranca o motor: segue esses eventos. Com --shm o
+// CDC é do segmento: os processos seguintes publicam no mesmo sem --cdc, e um
+// --cdc diferente do registado é recusado.
+// --lugares N faz de cada partição um voo com N lugares, com lista de espera.
+// --taxa-pedidos N dimensiona a tabela de pedidos idempotentes para N pedidos
+// por segundo durante os VALIDADE_DEDUP segundos em que se lembra de cada um.
+// --trinco-justo serve as partições por ordem de chegada (fila MCS); kill -USR1
+// imprime o perfil de contenção dos trincos.
+// Com --shm NOME (ex.: /taag) as reservas ficam nesse segmento POSIX, partilhado por
+// todos os processos lançados com o mesmo nome (e o mesmo --particoes).
+// LISTA é uma lista de CPUs como "0-3,8".
+int main(int argc, char *argv[]) {
+    const char *endereco_replica = NULL;
+    uint64_t semente = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+    int bench_executor = 0;
+    const char *endereco_carga = NULL;
+    long pedidos_carga = 0;
+    const char *endereco_pedido = NULL, *op_pedido = NULL, *pnr_pedido = NULL;
+    double horas_simulacao = 0;
+    long intervalo_ms = 1000;
+    const char *nome_gravacao = NULL, *nome_reproducao = NULL;
+    const char *nome_leitura_cdc = NULL;
+    int velocidade_maxima = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--primario") == 0 && i + 1 < argc) {
+            destino_replicacao = argv[++i];
+        } else if (strcmp(argv[i], "--replica") == 0 && i + 1 < argc) {
+            endereco_replica = argv[++i];
+            modo_replica = 1;
+        } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            nome_shm = argv[++i];
+        } else if (strcmp(argv[i], "--particoes") == 0 && i + 1 < argc) {
+            n_particoes = atoi(argv[++i]);
+            if (n_particoes < 1 || n_particoes > MAX_PARTICOES) {
+                fprintf(stderr, "--particoes deve estar entre 1 e %d\n", MAX_PARTICOES);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cpus-operacoes") == 0 && i + 1 < argc) {
+            if (lerListaCPUs(argv[++i], &cpus_operacoes) != 0) {
+                fprintf(stderr, "Lista de CPUs inválida: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cpus-expiracao") == 0 && i + 1 < argc) {
+            if (lerListaCPUs(argv[++i], &cpus_expiracao) != 0) {
+                fprintf(stderr, "Lista de CPUs inválida: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cpus-impressao") == 0 && i + 1 < argc) {
+            if (lerListaCPUs(argv[++i], &cpus_impressao) != 0) {
+                fprintf(stderr, "Lista de CPUs inválida: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--lote-expiracao") == 0 && i + 1 < argc) {
+            lote_expiracao = atoi(argv[++i]);
+            if (lote_expiracao < 1) {
+                fprintf(stderr, "--lote-expiracao deve ser positivo\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--max-bloqueio-us") == 0 && i + 1 < argc) {
+            max_bloqueio_us = atol(argv[++i]);
+            if (max_bloqueio_us < 1) {
+                fprintf(stderr, "--max-bloqueio-us deve ser positivo\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--vagas") == 0 && i + 1 < argc) {
+            vagas_escalonador = atoi(argv[++i]);
+            if (vagas_escalonador < 1) {
+                fprintf(stderr, "--vagas deve ser positivo\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--taxa-pedidos") == 0 && i + 1 < argc) {
+            taxa_dedup = atol(argv[++i]);
+            if (taxa_dedup < 1 || taxa_dedup > 10000000) {
+                fprintf(stderr, "--taxa-pedidos deve estar entre 1 e 10000000\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--trabalhadores") == 0 && i + 1 < argc) {
+            n_trabalhadores = atoi(argv[++i]);
+            if (n_trabalhadores < 1 || n_trabalhadores > MAX_TRABALHADORES) {
+                fprintf(stderr, "--trabalhadores deve estar entre 1 e %d\n", MAX_TRABALHADORES);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--servir") == 0 && i + 1 < argc) {
+            if (n_enderecos_servidor == MAX_ESCUTAS) {
+                fprintf(stderr, "No máximo %d endereços em --servir\n", MAX_ESCUTAS);
+                return 1;
+            }
+            enderecos_servidor[n_enderecos_servidor++] = argv[++i];
+        } else if (strcmp(argv[i], "--carga") == 0 && i + 2 < argc) {
+            endereco_carga = argv[++i];
+            pedidos_carga = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--pedir") == 0 && i + 3 < argc) {
+            endereco_pedido = argv[++i];
+            op_pedido = argv[++i];
+            pnr_pedido = argv[++i];
+        } else if (strcmp(argv[i], "--simular") == 0 && i + 1 < argc) {
+            horas_simulacao = atof(argv[++i]);
+            if (horas_simulacao <= 0) {
+                fprintf(stderr, "--simular deve ser positivo\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--intervalo-ms") == 0 && i + 1 < argc) {
+            intervalo_ms = atol(argv[++i]);
+            if (intervalo_ms < 0) {
+                fprintf(stderr, "--intervalo-ms não pode ser negativo\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bench-executor") == 0) {
+            bench_executor = 1;
+        } else if (strcmp(argv[i], "--semente") == 0 && i + 1 < argc) {
+            semente = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--gravar") == 0 && i + 1 < argc) {
+            nome_gravacao = argv[++i];
+        } else if (strcmp(argv[i], "--reproduzir") == 0 && i + 1 < argc) {
+            nome_reproducao = argv[++i];
+        } else if (strcmp(argv[i], "--velocidade-maxima") == 0) {
+            velocidade_maxima = 1;
+        } else if (strcmp(argv[i], "--lugares") == 0 && i + 1 < argc) {
+            lugares_por_voo = atoi(argv[++i]);
+            if (lugares_por_voo < 1 || lugares_por_voo > CAPACIDADE_PNR) {
+                fprintf(stderr, "--lugares deve estar entre 1 e %d\n", CAPACIDADE_PNR);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--promover-apos") == 0 && i + 1 < argc) {
+            promover_apos_s = atoi(argv[++i]);
+            if (promover_apos_s < 1) {
+                fprintf(stderr, "--promover-apos deve ser positivo\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--trinco-justo") == 0) {
+            trincos_justos = 1;
+        } else if (strcmp(argv[i], "--cdc") == 0 && i + 1 < argc) {
+            nome_cdc = argv[++i];
+            if (strlen(nome_cdc) >= MAX_NOME_CDC) {
+                fprintf(stderr, "--cdc: o nome tem de ter menos de %d caracteres\n", MAX_NOME_CDC);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cdc-ler") == 0 && i + 1 < argc) {
+            nome_leitura_cdc = argv[++i];
+        } else {
+            fprintf(stderr, "Uso: %s [--primario DESTINO | --replica DESTINO] [--shm NOME] [--particoes N]\n"
+                            "          [--cpus-operacoes LISTA] [--cpus-expiracao LISTA] [--cpus-impressao LISTA]\n"
+                            "          [--lote-expiracao N] [--max-bloqueio-us N] [--semente N] [--vagas N]\n"
+                            "          [--trabalhadores N] [--bench-executor] [--servir DESTINO]... [--carga DESTINO N]\n"
+                            "          [--pedir DESTINO OP PNR] [--simular HORAS] [--intervalo-ms N] [--gravar FICHEIRO]\n"
+                            "          [--reproduzir FICHEIRO [--velocidade-maxima]] [--cdc NOME] [--cdc-ler NOME]\n"
+                            "          [--lugares N] [--trinco-justo] [--promover-apos S] [--taxa-pedidos N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    semearGeradores(semente);
+    printf("Semente: %llu\n", (unsigned long long)semente);
+    if (bench_executor) {
+        benchExecutor();
+        return 0;
+    }
+    if (endereco_carga)
+        return gerarCarga(endereco_carga, pedidos_carga);
+    if (endereco_pedido)
+        return enviarPedido(endereco_pedido, op_pedido, pnr_pedido);
+    if (nome_leitura_cdc)
+        return lerCDC(nome_leitura_cdc);
+
+    RegistoTraco *registos_reproducao = NULL;
+    long n_reproducao = 0;
+    CabecalhoTraco c = { 0 };
+    if (nome_reproducao) {
+        n_reproducao = lerTraco(nome_reproducao, &c, &registos_reproducao);
+        if (n_reproducao < 0)
+            return 1;
+        atomic_store(&ceifeiro_em_pausa, 1);
+        printf("A reproduzir %ld registo(s) de %s (semente %llu, %d partição(ões)%s)\n", n_reproducao,
+               nome_reproducao, (unsigned long long)c.semente, c.n_particoes,
+               c.relogio_virtual ? ", tempo virtual" : "");
+    }
+
+    // Em simulação o main, o ceifeiro e a impressão são os participantes do
+    // relógio. A reprodução de uma simulação recomeça na hora virtual gravada,
+    // para que os prazos caiam nos mesmos segundos.
+    time_t fim_simulacao = 0, inicio_simulacao = 0;
+    int64_t inicio_real = agoraNs();
+    if (horas_simulacao > 0 && !modo_replica) {
+        relogioVirtual(c.relogio_virtual ? c.inicio_ms : 0);
+        inicio_simulacao = relogioAgora();
+        fim_simulacao = inicio_simulacao + (time_t)(horas_simulacao * 3600);
+        relogioParticipar();
+    }
+    iniciarTrincos();
+    if (abrirArmazem() != 0)
+        return 1;
+    if (abrirDedup() != 0)
+        return 1;
+    abrirCacheConsultas();
+
+    // SIGINT (Ctrl+C) e SIGTERM iniciam a drenagem; um segundo sinal sai logo
+    struct sigaction sa = { .sa_handler = pedirDrenagem };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    struct sigaction perfil = { .sa_handler = trincoPedirPerfil };
+    sigemptyset(&perfil.sa_mask);
+    sigaction(SIGUSR1, &perfil, NULL);
+
+    // A réplica só continua para o motor completo se for promovida
+    pthread_t printThread = 0;
+    if (modo_replica) {
+        struct sigaction promocao = { .sa_handler = pedirPromocao };
+        sigemptyset(&promocao.sa_mask);
+        sigaction(SIGUSR2, &promocao, NULL);
+        int r = executarReplica(endereco_replica, &printThread);
+        if (r != REPLICA_PROMOVIDA)
+            return r;
+        modo_replica = 0;
+    }
+    if (nome_gravacao && abrirTraco(nome_gravacao, semente) != 0)
+        return 1;
+    if (nome_cdc && abrirCDC(nome_cdc) != 0)
+        return 1;
+
+    // No modo primário, uma thread envia os eventos à réplica
+    pthread_t replicacaoThread = 0;
+    if (destino_replicacao)
+        pthread_create(&replicacaoThread, NULL, replicacao_thread, NULL);
+
+    // Cria a thread que verifica os PNRs com timeout
+    pthread_t timeoutThread;
+    pthread_attr_t attr;
+    relogioParticipar();
+    atributosFixados(&attr, &cpus_expiracao);
+    pthread_create(&timeoutThread, &attr, verificador_timeout, NULL);
+    pthread_attr_destroy(&attr);
+
+    // Cria a thread que exibe as reservas a cada 30 segundos (a réplica
+    // promovida já tem a sua)
+    if (!printThread) {
+        relogioParticipar();
+        atributosFixados(&attr, &cpus_impressao);
+        pthread_create(&printThread, &attr, impressao_thread, NULL);
+        pthread_attr_destroy(&attr);
+    }
+
+    // Trabalhadores que executam as operações; sem eles cada operação corre
+    // na thread que a pede
+    executor = executorCriar(n_trabalhadores, 0, 1);
+    if (!executor)
+        printf("Sem executor: as operações correm na thread que as pede.\n");
+
+    // Servidor de pedidos para clientes externos
+    pthread_t servidorThread;
+    if (n_enderecos_servidor > 0)
+        pthread_create(&servidorThread, NULL, servidor_thread, NULL);
+
+    if (registos_reproducao) {
+        reproduzirTraco(registos_reproducao, n_reproducao, velocidade_maxima);
+        free(registos_reproducao);
+        atomic_store(&ceifeiro_em_pausa, 0);
+        pedirDrenagem(0);
+    } else {
+        simularClientes(fim_simulacao, intervalo_ms);
+    }
+    relogioSair();
+
+    // Se alguma operação ficou presa, sai sem libertar o que ela ainda pode usar
+    if (!drenarMotor(timeoutThread, printThread, replicacaoThread))
+        return 1;
+    if (n_enderecos_servidor > 0) {
+        atomic_store(&parar_servidor, 1);
+        pthread_join(servidorThread, NULL);
     }
+    executorParar(executor);
+    executor = NULL;
+    fecharTraco();
+    fecharCDC();
+    if (relogio_virtual)
+        printf("Simulação: %.1f h de tempo virtual em %.1f s\n",
+               (relogioAgora() - inicio_simulacao) / 3600.0, (agoraNs() - inicio_real) / 1e9);
 
-    // Código de limpeza (nunca alcançado neste exemplo)
-    pthread_mutex_destroy(&meuPNR_mutex);
-    sem_destroy(&sem_reserva);
-    sem_destroy(&sem_consulta);
-    sem_destroy(&sem_pagamento);
-    sem_destroy(&sem_cancelamento);
+    // Limpeza
+    fecharArmazem();
 
     return 0;
 }
 
+#endif
@@ -0,0 +1,60 @@
+#include "aleatorio.h"
+
+static inline uint64_t rodar_esquerda(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+void semearAleatorio(Aleatorio *g, uint64_t semente) {
+    for (int j = 0; j < 4; j++) {
+        uint64_t z = (semente += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        g->s[j] = z ^ (z >> 31);
+    }
+}
+
+uint64_t proximoAleatorio(Aleatorio *g) {
+    uint64_t resultado = rodar_esquerda(g->s[1] * 5, 7) * 9;
+    uint64_t t = g->s[1] << 17;
+    g->s[2] ^= g->s[0];
+    g->s[3] ^= g->s[1];
+    g->s[1] ^= g->s[2];
+    g->s[0] ^= g->s[3];
+    g->s[2] ^= t;
+    g->s[3] = rodar_esquerda(g->s[3], 45);
+    return resultado;
+}
+
+void saltarAleatorio(Aleatorio *g) {
+    static const uint64_t SALTO[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                      0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+    uint64_t s[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (SALTO[i] & (1ULL << b)) {
+                for (int j = 0; j < 4; j++)
+                    s[j] ^= g->s[j];
+            }
+            proximoAleatorio(g);
+        }
+    }
+    for (int j = 0; j < 4; j++)
+        g->s[j] = s[j];
+}
+
+// Multiplicação e deslocamento (Lemire) com rejeição: os 32 bits de baixo do
+// produto abaixo de 2^32 mod n marcam os valores a mais de algumas saídas, e
+// esses sorteios repetem-se. A rejeição é rara (probabilidade < n / 2^32) e o
+// módulo só se calcula quando pode haver uma.
+uint32_t aleatorioEm(Aleatorio *g, uint32_t n) {
+    uint64_t m = (proximoAleatorio(g) >> 32) * n;
+    uint32_t baixo = (uint32_t)m;
+    if (baixo < n) {
+        uint32_t limiar = -n % n;
+        while (baixo < limiar) {
+            m = (proximoAleatorio(g) >> 32) * n;
+            baixo = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
@@ -0,0 +1,28 @@
+// Gerador xoshiro256** partilhado por Projeto.c e main.c, em vez do rand()
+// (estado global e serializado pela glibc). Cada gerador tem o seu estado; o
+// programa dá a cada thread ou cliente um fluxo próprio avançando um gerador
+// base 2^128 passos (saltarAleatorio) por fluxo, por isso os fluxos nunca se
+// sobrepõem e, com a mesma semente, cada fluxo é reproduzível.
+// Compilar com o programa: make (ver Makefile)
+#ifndef ALEATORIO_H
+#define ALEATORIO_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint64_t s[4];
+} Aleatorio;
+
+// Inicializa g a partir de uma semente de 64 bits (splitmix64)
+void semearAleatorio(Aleatorio *g, uint64_t semente);
+
+// Próximo valor de 64 bits
+uint64_t proximoAleatorio(Aleatorio *g);
+
+// Avança g 2^128 passos (função de salto do xoshiro256**)
+void saltarAleatorio(Aleatorio *g);
+
+// Inteiro aleatório uniforme em [0, n) (0 se n == 0)
+uint32_t aleatorioEm(Aleatorio *g, uint32_t n);
+
+#endif
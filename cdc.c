@@ -0,0 +1,341 @@
+#include "projeto.h"
+#include "cdc.h"
+
+#define MAGIA_CDC 0x43444331   // "CDC1"
+#define CAPACIDADE_CDC 16384   // eventos por anel (potência de 2)
+#define MAX_CONSUMIDORES_CDC 16
+
+typedef struct {
+    atomic_ullong seq;         // seq do evento nesta posição; 0 enquanto é escrito
+    atomic_llong instante_ms;
+    atomic_llong timestamp;
+    atomic_uint pnr;
+    atomic_short tipo;
+    atomic_short pago;
+} EventoCDC;
+
+typedef struct {
+    uint32_t pnr;
+    int32_t pago;
+    int64_t timestamp;
+} ReservaCDC;
+
+typedef struct {
+    atomic_ullong cabeca;      // seq do último evento publicado
+    atomic_uint pedidos;       // snapshots pedidos pelos consumidores
+    atomic_uint atendidos;     // pedidos já servidos (futex dos consumidores)
+    atomic_uint geracao;       // ímpar enquanto o snapshot é escrito
+    int32_t n_snapshot;
+    uint64_t seq_snapshot;     // último evento incluído no snapshot
+    _Alignas(64) EventoCDC eventos[CAPACIDADE_CDC];
+    ReservaCDC snapshot[CAPACIDADE_PNR];
+} AnelCDC;
+
+typedef struct {
+    atomic_int pid;                       // 0 = posição livre
+    atomic_ullong posicao[MAX_PARTICOES]; // seq do próximo evento a ler
+    atomic_ulong perdidos, recuperacoes;
+} ConsumidorCDC;
+
+typedef struct {
+    atomic_uint magia;
+    int32_t n_aneis;
+    atomic_uint sinal;            // muda com os eventos quando há consumidores à espera
+    atomic_int a_dormir;
+    atomic_uint pedidos_snapshot; // futex da thread CDC
+    ConsumidorCDC consumidores[MAX_CONSUMIDORES_CDC];
+    AnelCDC aneis[];
+} SegmentoCDC;
+
+static SegmentoCDC *cdc = NULL;
+static size_t tamanho_cdc;
+static pthread_t cdc_thread_id;
+static atomic_ulong snapshots_cdc = 0;
+
+// Só o produtor do anel (quem tem a partição bloqueada) chama esta função
+static void publicarNoAnel(AnelCDC *anel, int tipo, uint32_t pnr, time_t timestamp, int pago) {
+    uint64_t seq = atomic_load_explicit(&anel->cabeca, memory_order_relaxed) + 1;
+    EventoCDC *e = &anel->eventos[seq & (CAPACIDADE_CDC - 1)];
+    atomic_store_explicit(&e->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&e->instante_ms, agoraMs(), memory_order_relaxed);
+    atomic_store_explicit(&e->timestamp, timestamp, memory_order_relaxed);
+    atomic_store_explicit(&e->pnr, pnr, memory_order_relaxed);
+    atomic_store_explicit(&e->tipo, tipo, memory_order_relaxed);
+    atomic_store_explicit(&e->pago, pago, memory_order_relaxed);
+    atomic_store_explicit(&e->seq, seq, memory_order_release);
+    atomic_store(&anel->cabeca, seq);
+
+    // Só se paga a chamada ao sistema se algum consumidor adormeceu
+    if (atomic_load(&cdc->a_dormir) > 0) {
+        atomic_fetch_add(&cdc->sinal, 1);
+        futexAcordar(&cdc->sinal, INT_MAX);
+    }
+}
+
+void publicarCDC(int tipo, uint32_t pnr, time_t timestamp, int pago) {
+    if (cdc)
+        publicarNoAnel(&cdc->aneis[particaoDoPNR(pnr)], tipo, pnr, timestamp, pago);
+}
+
+// Lê o evento seq do anel para e. Retorna 1 se o leu, 0 se ainda não foi
+// publicado, -1 se já foi escrito por cima (o consumidor ficou para trás).
+static int lerEventoCDC(AnelCDC *anel, uint64_t seq, EventoReplicacao *e) {
+    EventoCDC *origem = &anel->eventos[seq & (CAPACIDADE_CDC - 1)];
+    uint64_t antes = atomic_load_explicit(&origem->seq, memory_order_acquire);
+    if (antes != seq) {
+        uint64_t cabeca = atomic_load(&anel->cabeca);
+        if (cabeca < seq)
+            return 0;
+        return cabeca - seq >= CAPACIDADE_CDC ? -1 : 0; // 0: a meio da escrita
+    }
+    e->seq = seq;
+    e->instante_ms = atomic_load_explicit(&origem->instante_ms, memory_order_relaxed);
+    e->timestamp = atomic_load_explicit(&origem->timestamp, memory_order_relaxed);
+    e->pnr = atomic_load_explicit(&origem->pnr, memory_order_relaxed);
+    e->tipo = atomic_load_explicit(&origem->tipo, memory_order_relaxed);
+    e->pago = atomic_load_explicit(&origem->pago, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&origem->seq, memory_order_relaxed) == seq ? 1 : -1;
+}
+
+// Escreve o snapshot da partição p e marca como servidos os pedidos até pedidos
+static void escreverSnapshotCDC(int p, unsigned pedidos) {
+    AnelCDC *anel = &cdc->aneis[p];
+    ArmazemPNR *a = bloquearPNR(p);
+    atomic_fetch_add(&anel->geracao, 1);
+    atomic_thread_fence(memory_order_release);
+    int n = a->n_reservas;
+    for (int k = 0; k < n; k++) {
+        PNRNode *no = NO(a, DENSOS(a)[k]);
+        anel->snapshot[k] = (ReservaCDC){ no->pnr, pagoDe(no), momentoDe(no) };
+    }
+    anel->n_snapshot = n;
+    anel->seq_snapshot = atomic_load(&anel->cabeca);
+    atomic_fetch_add_explicit(&anel->geracao, 1, memory_order_release);
+    desbloquearPNR(p);
+
+    atomic_store(&anel->atendidos, pedidos);
+    futexAcordar(&anel->atendidos, INT_MAX);
+    atomic_fetch_add(&snapshots_cdc, 1);
+}
+
+// Thread do motor que serve os pedidos de snapshot dos consumidores
+static void* cdc_thread(void* arg) {
+    while (motorAtivo()) {
+        unsigned visto = atomic_load(&cdc->pedidos_snapshot);
+        for (int p = 0; p < n_particoes; p++) {
+            unsigned pedidos = atomic_load(&cdc->aneis[p].pedidos);
+            if (atomic_load(&cdc->aneis[p].atendidos) != pedidos)
+                escreverSnapshotCDC(p, pedidos);
+        }
+        futexEsperar(&cdc->pedidos_snapshot, visto, 100);
+    }
+    return NULL;
+}
+
+// Mapeia o segmento NOME; criar=1 cria-o se ainda não existir (o motor)
+static SegmentoCDC *mapearCDC(const char *nome, int criar, int n_aneis) {
+    int criador = 0;
+    int fd = criar ? shm_open(nome, O_RDWR | O_CREAT | O_EXCL, 0600) : -1;
+    if (fd != -1)
+        criador = 1;
+    else if (!criar || errno == EEXIST)
+        fd = shm_open(nome, O_RDWR, 0600);
+    if (fd == -1) {
+        perror("Erro ao abrir o segmento CDC");
+        return NULL;
+    }
+    if (criador) {
+        tamanho_cdc = sizeof(SegmentoCDC) + (size_t)n_aneis * sizeof(AnelCDC);
+        if (ftruncate(fd, tamanho_cdc) == -1) {
+            perror("Erro ao abrir o segmento CDC");
+            close(fd);
+            return NULL;
+        }
+    } else {
+        struct stat st;
+        fstat(fd, &st);
+        tamanho_cdc = st.st_size;
+    }
+    SegmentoCDC *s = tamanho_cdc < sizeof(SegmentoCDC) ? MAP_FAILED
+                   : mmap(NULL, tamanho_cdc, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s == MAP_FAILED) {
+        perror("Erro ao mapear o segmento CDC");
+        return NULL;
+    }
+    if (criador) {
+        s->n_aneis = n_aneis; // o resto já vem a zeros
+        atomic_store(&s->magia, MAGIA_CDC);
+    } else {
+        while (atomic_load(&s->magia) != MAGIA_CDC)
+            usleep(1000); // espera que o criador acabe de inicializar
+        if (n_aneis && s->n_aneis != n_aneis) {
+            fprintf(stderr, "O segmento CDC %s tem %d anéis e o motor %d partições\n", nome, s->n_aneis, n_aneis);
+            munmap(s, tamanho_cdc);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+int abrirCDC(const char *nome) {
+    cdc = mapearCDC(nome, 1, n_particoes);
+    if (!cdc)
+        return -1;
+    if (nome_shm == NULL) {
+        for (int p = 0; p < n_particoes; p++) {
+            bloquearPNR(p);
+            publicarNoAnel(&cdc->aneis[p], EVENTO_SNAPSHOT, 0, 0, 0);
+            desbloquearPNR(p);
+        }
+    }
+    pthread_create(&cdc_thread_id, NULL, cdc_thread, NULL);
+    printf("[CDC] Eventos publicados em %s (%d anel(éis) de %d eventos).\n", nome, n_particoes, CAPACIDADE_CDC);
+    return 0;
+}
+
+void fecharCDC(void) {
+    if (!cdc)
+        return;
+    atomic_fetch_add(&cdc->pedidos_snapshot, 1);
+    futexAcordar(&cdc->pedidos_snapshot, 1);
+    pthread_join(cdc_thread_id, NULL);
+    munmap(cdc, tamanho_cdc);
+    cdc = NULL;
+}
+
+void imprimirMetricasCDC(void) {
+    if (!cdc)
+        return;
+    unsigned long long publicados = 0;
+    for (int p = 0; p < n_particoes; p++)
+        publicados += atomic_load(&cdc->aneis[p].cabeca);
+    printf("[CDC] eventos publicados: %llu | snapshots servidos: %lu\n",
+           publicados, atomic_load(&snapshots_cdc));
+    for (int c = 0; c < MAX_CONSUMIDORES_CDC; c++) {
+        ConsumidorCDC *cons = &cdc->consumidores[c];
+        int pid = atomic_load(&cons->pid);
+        if (pid == 0)
+            continue;
+        if (kill(pid, 0) == -1 && errno == ESRCH) {
+            printf("[CDC] consumidor %d terminou sem se desligar; posição libertada.\n", pid);
+            atomic_compare_exchange_strong(&cons->pid, &pid, 0);
+            continue;
+        }
+        uint64_t atraso = 0;
+        for (int p = 0; p < n_particoes; p++) {
+            uint64_t cabeca = atomic_load(&cdc->aneis[p].cabeca), pos = atomic_load(&cons->posicao[p]);
+            if (cabeca + 1 > pos && cabeca + 1 - pos > atraso)
+                atraso = cabeca + 1 - pos;
+        }
+        printf("[CDC] consumidor %d: atraso %llu evento(s)%s | perdidos: %lu | recuperações por snapshot: %lu\n",
+               pid, (unsigned long long)atraso, atraso > CAPACIDADE_CDC / 2 ? " (LENTO)" : "",
+               atomic_load(&cons->perdidos), atomic_load(&cons->recuperacoes));
+    }
+}
+
+// Consumidor: pede o snapshot da partição p, entrega as reservas que ele tem
+// e devolve o seq a partir do qual se continua a ler o anel
+static uint64_t recuperarCDC(int p, ReservaCDC *copia) {
+    AnelCDC *anel = &cdc->aneis[p];
+    unsigned alvo = atomic_fetch_add(&anel->pedidos, 1) + 1;
+    atomic_fetch_add(&cdc->pedidos_snapshot, 1);
+    futexAcordar(&cdc->pedidos_snapshot, 1);
+    unsigned atendidos;
+    while ((int)((atendidos = atomic_load(&anel->atendidos)) - alvo) < 0) {
+        if (!motorAtivo())
+            return atomic_load(&anel->cabeca) + 1;
+        futexEsperar(&anel->atendidos, atendidos, 100);
+    }
+
+    unsigned geracao;
+    int n;
+    uint64_t seq;
+    do {
+        while ((geracao = atomic_load_explicit(&anel->geracao, memory_order_acquire)) & 1)
+            sched_yield();
+        n = anel->n_snapshot;
+        seq = anel->seq_snapshot;
+        memcpy(copia, anel->snapshot, n * sizeof(ReservaCDC));
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&anel->geracao, memory_order_relaxed) != geracao);
+
+    printf("[CDC] partição %d: snapshot até ao seq %llu com %d reserva(s)\n", p, (unsigned long long)seq, n);
+    for (int k = 0; k < n; k++)
+        printf("[CDC] partição %d snapshot: PNR %s, %s\n", p, textoPNR(copia[k].pnr).texto, copia[k].pago ? "pago" : "por pagar");
+    return seq + 1;
+}
+
+int lerCDC(const char *nome) {
+    static const char *NOMES_EVENTOS[] = { "", "reserva", "pagamento", "cancelamento", "expiração", "recomeço" };
+    cdc = mapearCDC(nome, 0, 0);
+    if (!cdc)
+        return 1;
+    n_particoes = cdc->n_aneis;
+    ConsumidorCDC *eu = NULL;
+    for (int c = 0; c < MAX_CONSUMIDORES_CDC && !eu; c++) {
+        int livre = 0;
+        if (atomic_compare_exchange_strong(&cdc->consumidores[c].pid, &livre, getpid()))
+            eu = &cdc->consumidores[c];
+    }
+    if (!eu) {
+        fprintf(stderr, "Já há %d consumidores ligados a %s\n", MAX_CONSUMIDORES_CDC, nome);
+        return 1;
+    }
+    struct sigaction sa = { .sa_handler = pedirDrenagem };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    ReservaCDC *copia = malloc(CAPACIDADE_PNR * sizeof(ReservaCDC));
+    uint64_t pos[MAX_PARTICOES];
+    unsigned long lidos = 0;
+    printf("[CDC] A ler %s: %d partição(ões).\n", nome, n_particoes);
+    for (int p = 0; p < n_particoes; p++)
+        atomic_store(&eu->posicao[p], pos[p] = recuperarCDC(p, copia));
+
+    while (motorAtivo()) {
+        int novos = 0;
+        for (int p = 0; p < n_particoes; p++) {
+            EventoReplicacao e;
+            int r;
+            while ((r = lerEventoCDC(&cdc->aneis[p], pos[p], &e)) != 0) {
+                if (r == -1) {
+                    uint64_t cabeca = atomic_load(&cdc->aneis[p].cabeca);
+                    printf("[CDC] partição %d: consumidor atrasado (seq %llu, cabeça %llu); a recuperar pelo snapshot\n",
+                           p, (unsigned long long)pos[p], (unsigned long long)cabeca);
+                    atomic_fetch_add(&eu->perdidos, cabeca + 1 - pos[p]);
+                    atomic_fetch_add(&eu->recuperacoes, 1);
+                    pos[p] = recuperarCDC(p, copia);
+                    continue;
+                }
+                printf("[CDC] partição %d seq %llu: %s PNR %s%s\n", p, (unsigned long long)e.seq,
+                       NOMES_EVENTOS[e.tipo], textoPNR(e.pnr).texto, e.pago ? " (pago)" : "");
+                pos[p]++;
+                novos++;
+            }
+            atomic_store(&eu->posicao[p], pos[p]);
+        }
+        lidos += novos;
+        if (novos)
+            continue;
+
+        // Nada de novo: adormece até um produtor publicar (ou 100 ms)
+        atomic_fetch_add(&cdc->a_dormir, 1);
+        unsigned sinal = atomic_load(&cdc->sinal);
+        int ha = 0;
+        for (int p = 0; p < n_particoes && !ha; p++)
+            ha = atomic_load(&cdc->aneis[p].cabeca) >= pos[p];
+        if (!ha)
+            futexEsperar(&cdc->sinal, sinal, 100);
+        atomic_fetch_sub(&cdc->a_dormir, 1);
+    }
+    printf("[CDC] %lu evento(s) lidos, %lu perdido(s), %lu recuperação(ões) por snapshot\n",
+           lidos, atomic_load(&eu->perdidos), atomic_load(&eu->recuperacoes));
+    atomic_store(&eu->pid, 0);
+    free(copia);
+    munmap(cdc, tamanho_cdc);
+    return 0;
+}
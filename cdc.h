@@ -0,0 +1,45 @@
+// Com --cdc NOME os eventos do armazenamento (reserva, pagamento,
+// cancelamento, expiração) são publicados no segmento POSIX NOME, com um anel
+// por partição. Cada anel tem um só produtor, porque os eventos são emitidos
+// com a partição bloqueada (também com vários processos --shm a partilhar o
+// segmento). Os consumidores (--cdc-ler NOME, ou qualquer processo que mapeie
+// o segmento) leem os eventos diretamente do anel, sem chamadas ao sistema, e
+// nunca atrasam o produtor. Cada posição guarda o seq do seu evento, escrito
+// por último (como num seqlock), por isso um consumidor que ficou mais de
+// CAPACIDADE_CDC eventos para trás encontra um seq maior do que o esperado.
+// Para recuperar pede um snapshot da partição: a thread CDC do motor escreve
+// na área do anel as reservas existentes e o seq do último evento incluído, e
+// o consumidor continua a ler o anel a partir daí. As posições dos
+// consumidores ficam no segmento, para o relatório mostrar os atrasados.
+// Com --shm o nome do segmento CDC fica registado nas partições (ver
+// conferirCDC), para que todos os processos publiquem.
+// Compilar com o programa: make (ver Makefile)
+#ifndef CDC_H
+#define CDC_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Liga o motor ao segmento CDC e arranca a thread dos snapshots. Sem --shm o
+// armazenamento começa vazio: cada anel recebe um EVENTO_SNAPSHOT, para os
+// consumidores esquecerem o que tinham da execução anterior.
+int abrirCDC(const char *nome);
+
+// Pára a thread dos snapshots e desmapeia o segmento, que continua
+// disponível para os consumidores (remover com rm /dev/shm/NOME). Só depois
+// de parados todos os que emitem eventos.
+void fecharCDC(void);
+
+// Chamada por emitirEvento, com a partição do PNR bloqueada
+void publicarCDC(int tipo, uint32_t pnr, time_t timestamp, int pago);
+
+// Eventos publicados, snapshots servidos e o atraso de cada consumidor (um
+// consumidor com mais de metade do anel por ler é dado como lento)
+void imprimirMetricasCDC(void);
+
+// --cdc-ler NOME: segue os eventos de todas as partições até SIGINT/SIGTERM.
+// Começa por um snapshot de cada partição e recorre a ele sempre que fica
+// para trás.
+int lerCDC(const char *nome);
+
+#endif
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "controlo.h"
+
+atomic_int estado_global = EXECUTAR;
+
+static int pipe_controlo[2]; // usado pelo main para acordar a thread de controlo no fim
+static pthread_t thread_controlo;
+static char caminho_socket[108];
+
+// Espera no futex do estado global enquanto o valor for "esperado"
+static void futex_esperar(atomic_int *endereco, int esperado) {
+    syscall(SYS_futex, (int*)endereco, FUTEX_WAIT_PRIVATE, esperado, NULL, NULL, 0);
+}
+
+// Acorda todas as threads bloqueadas no futex do estado global
+static void futex_acordar_todos(atomic_int *endereco) {
+    syscall(SYS_futex, (int*)endereco, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// Muda o estado global e acorda quem estiver em pausa. ENCERRAR e definitivo.
+static void definir_estado(int novo) {
+    int atual = atomic_load(&estado_global);
+    do {
+        if (atual == ENCERRAR || (atual == DRENAR && novo != ENCERRAR))
+            return;
+    } while (!atomic_compare_exchange_weak(&estado_global, &atual, novo));
+    futex_acordar_todos(&estado_global);
+}
+
+bool verificar_interrupcao(void) {
+    int estado;
+    while ((estado = atomic_load(&estado_global)) == PAUSAR)
+        futex_esperar(&estado_global, PAUSAR);
+    return estado == EXECUTAR;
+}
+
+// Aplica um comando de um caractere vindo do teclado ou do socket de controlo.
+// Retorna o instante em que a pausa temporaria deve acabar (0 se nao houver).
+static time_t aplicar_comando(char c, time_t fim_pausa) {
+    switch (c) {
+        case ' ':
+            printf("\n[Interrupcao] Barra de espaço pressionada. Pausando por %d segundos...\n", PAUSA_ESPACO);
+            definir_estado(PAUSAR);
+            return time(NULL) + PAUSA_ESPACO;
+        case 'p':
+            printf("\n[Controlo] Pausa global.\n");
+            definir_estado(PAUSAR);
+            return 0;
+        case 'r':
+            printf("\n[Controlo] Execucao retomada.\n");
+            definir_estado(EXECUTAR);
+            return 0;
+        case 'd':
+            printf("\n[Controlo] Drenagem: os clientes terminam a operacao atual e saem.\n");
+            definir_estado(DRENAR);
+            return 0;
+        case 'q':
+            printf("\n[Controlo] Encerramento pedido.\n");
+            definir_estado(ENCERRAR);
+            return 0;
+    }
+    return fim_pausa;
+}
+
+// Abre o socket Unix de controlo. Retorna -1 se nao for possivel (o programa
+// continua apenas com o teclado).
+static int abrir_socket_controlo(void) {
+    struct sockaddr_un endereco = { .sun_family = AF_UNIX };
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd == -1) {
+        perror("socket()");
+        return -1;
+    }
+    snprintf(endereco.sun_path, sizeof(endereco.sun_path), "%s", caminho_socket);
+    unlink(caminho_socket); // resto de uma instância anterior com o mesmo pid
+    if (bind(fd, (struct sockaddr*)&endereco, sizeof(endereco)) == -1 || listen(fd, MAX_CONTROLADORES) == -1) {
+        perror("bind()/listen()");
+        close(fd);
+        return -1;
+    }
+    printf("[Controlo] Socket de controlo: %s\n", caminho_socket);
+    return fd;
+}
+
+// Lê comandos de fd. Retorna 0 se a ligação continua, -1 no fim ou num erro
+// (EAGAIN/EINTR não contam: o teclado pode estar em modo não bloqueante).
+static int ler_comandos(int fd, time_t *fim_pausa) {
+    char buf[64];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n == -1)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    for (ssize_t j = 0; j < n; j++)
+        *fim_pausa = aplicar_comando(buf[j], *fim_pausa);
+    return n == 0 ? -1 : 0;
+}
+
+// Thread de controlo: unica dona da entrada. Espera em poll() pelo teclado,
+// pelo socket de controlo e pelo pipe do main.
+static void* controlo(void* args) {
+    struct pollfd fds[3 + MAX_CONTROLADORES];
+    int n_controladores = 0;
+    time_t fim_pausa = 0;
+    int i;
+
+    (void)args;
+    fds[0].fd = STDIN_FILENO;
+    fds[1].fd = abrir_socket_controlo();
+    fds[2].fd = pipe_controlo[0];
+    for (i = 0; i < 3; i++)
+        fds[i].events = POLLIN;
+
+    while (atomic_load(&estado_global) != ENCERRAR) {
+        int espera = -1;
+        if (fim_pausa != 0) {
+            time_t agora = time(NULL);
+            if (agora >= fim_pausa) {
+                fim_pausa = 0;
+                definir_estado(EXECUTAR);
+                continue;
+            }
+            espera = (int)(fim_pausa - agora) * 1000;
+        }
+
+        if (poll(fds, 3 + n_controladores, espera) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll()");
+            break;
+        }
+
+        // Teclado
+        if ((fds[0].revents & (POLLIN | POLLHUP)) && ler_comandos(STDIN_FILENO, &fim_pausa) != 0)
+            fds[0].fd = -1; // fim do stdin: so resta o socket
+
+        // Nova ligacao ao socket de controlo
+        if (fds[1].fd != -1 && (fds[1].revents & POLLIN)) {
+            int cliente = accept(fds[1].fd, NULL, NULL);
+            if (cliente != -1 && n_controladores < MAX_CONTROLADORES) {
+                fds[3 + n_controladores].fd = cliente;
+                fds[3 + n_controladores].events = POLLIN;
+                fds[3 + n_controladores].revents = 0;
+                n_controladores++;
+            } else if (cliente != -1) {
+                close(cliente);
+            }
+        }
+
+        // Comandos vindos das ligacoes de controlo
+        for (i = 3; i < 3 + n_controladores; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP)))
+                continue;
+            if (ler_comandos(fds[i].fd, &fim_pausa) != 0) {
+                close(fds[i].fd);
+                fds[i] = fds[3 + --n_controladores];
+                i--;
+            }
+        }
+        // fds[2] (pipe do main) so serve para acordar o poll()
+    }
+
+    for (i = 3; i < 3 + n_controladores; i++)
+        close(fds[i].fd);
+    if (fds[1].fd != -1) {
+        close(fds[1].fd);
+        unlink(caminho_socket);
+    }
+    return NULL;
+}
+
+int iniciar_controlo(const char *programa) {
+    snprintf(caminho_socket, sizeof(caminho_socket), "/tmp/taag_%s.%d.sock", programa, (int)getpid());
+    if (pipe(pipe_controlo) == -1) {
+        perror("pipe()");
+        return -1;
+    }
+    if (pthread_create(&thread_controlo, NULL, controlo, NULL) != 0) {
+        fprintf(stderr, "Erro ao criar a thread de controlo.\n");
+        close(pipe_controlo[0]);
+        close(pipe_controlo[1]);
+        return -1;
+    }
+    return 0;
+}
+
+void terminar_controlo(void) {
+    atomic_store(&estado_global, ENCERRAR);
+    // Acorda o poll(); se não for possível, cancela a thread (poll() é um
+    // ponto de cancelamento) em vez de esperar por ela para sempre
+    ssize_t n;
+    while ((n = write(pipe_controlo[1], "x", 1)) == -1 && errno == EINTR)
+        ;
+    if (n != 1) {
+        perror("write()");
+        pthread_cancel(thread_controlo);
+    }
+    pthread_join(thread_controlo, NULL);
+    close(pipe_controlo[0]);
+    close(pipe_controlo[1]);
+}
@@ -0,0 +1,34 @@
+// Thread de controlo partilhada por main1.c e espaco.c: é a única dona da
+// entrada (teclado e socket Unix de controlo) e difunde pausa/retoma/
+// drenagem/encerramento a todos os clientes através de estado_global.
+// Compilar com o programa: gcc main1.c controlo.c -pthread
+#ifndef CONTROLO_H
+#define CONTROLO_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define MAX_CONTROLADORES 8 // ligacoes simultaneas ao socket de controlo
+#define PAUSA_ESPACO 5      // segundos de pausa global ao carregar na barra de espaco
+
+// Estado partilhado por todas as threads, difundido pela thread de controlo
+enum { EXECUTAR = 0, PAUSAR, DRENAR, ENCERRAR };
+
+extern atomic_int estado_global;
+
+// Arranca a thread de controlo. O socket de controlo fica em
+// /tmp/taag_<programa>.<pid>.sock (ex.: echo p | nc -U ...), por isso dois
+// programas (ou duas instâncias) nunca tiram o socket um ao outro.
+// Retorna 0 em caso de sucesso.
+int iniciar_controlo(const char *programa);
+
+// Chamada pelo main quando todos os clientes terminaram: encerra a thread de
+// controlo e remove o socket
+void terminar_controlo(void);
+
+// Chamada por cada cliente antes de cada operacao: so le o estado partilhado
+// (sem syscall no caso normal) e dorme no futex enquanto a pausa global durar.
+// Retorna false quando o cliente deve terminar (drenagem ou encerramento).
+bool verificar_interrupcao(void);
+
+#endif
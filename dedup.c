@@ -0,0 +1,220 @@
+#include "projeto.h"
+#include "dedup.h"
+
+#define VIAS_DEDUP 4
+#define MIN_CONJUNTOS_DEDUP 1024
+#define MAX_TRANSBORDO_DEDUP 8  // entradas de transbordo por conjunto
+
+typedef struct EntradaDedup {
+    uint64_t id;              // 0 = entrada livre
+    time_t criado;
+    int concluido;
+    Resultado resultado;
+    struct EntradaDedup *prox; // transbordo do conjunto ou reserva livre
+} EntradaDedup;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t concluido; // repetições à espera do pedido original
+    EntradaDedup vias[VIAS_DEDUP];
+    EntradaDedup *transbordo; // entradas a mais quando as vias estão todas em validade
+    int n_transbordo;
+} ConjuntoDedup;
+
+long taxa_dedup = TAXA_DEDUP;
+static ConjuntoDedup *dedup = NULL;
+static int bits_dedup;
+static atomic_long dedup_novos = 0, dedup_repetidos = 0, dedup_despejados = 0, dedup_recusados = 0;
+static atomic_long dedup_transbordo = 0, dedup_transbordo_max = 0;
+
+// Reserva de entradas de transbordo, alocada com a tabela (uma por conjunto)
+// e partilhada por todos os conjuntos. Bloqueia-se sempre depois do mutex do
+// conjunto.
+static EntradaDedup *reserva_dedup = NULL;
+static EntradaDedup *livres_dedup = NULL;
+static pthread_mutex_t reserva_dedup_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Conjuntos (potência de 2) para taxa_dedup * VALIDADE_DEDUP entradas
+int abrirDedup(void) {
+    long entradas = taxa_dedup * VALIDADE_DEDUP;
+    long conjuntos = MIN_CONJUNTOS_DEDUP;
+    for (bits_dedup = 10; conjuntos * VIAS_DEDUP < entradas; bits_dedup++)
+        conjuntos *= 2;
+    dedup = calloc(conjuntos, sizeof(ConjuntoDedup));
+    reserva_dedup = calloc(conjuntos, sizeof(EntradaDedup));
+    if (!dedup || !reserva_dedup) {
+        perror("Erro ao alocar a tabela de pedidos");
+        free(dedup);
+        free(reserva_dedup);
+        dedup = NULL;
+        reserva_dedup = NULL;
+        return -1;
+    }
+    for (long k = 0; k < conjuntos; k++) {
+        reserva_dedup[k].prox = livres_dedup;
+        livres_dedup = &reserva_dedup[k];
+    }
+    for (long c = 0; c < conjuntos; c++) {
+        pthread_mutex_init(&dedup[c].mutex, NULL);
+        pthread_cond_init(&dedup[c].concluido, NULL);
+    }
+    return 0;
+}
+
+static ConjuntoDedup* conjuntoDedup(uint64_t id) {
+    return &dedup[(id * 0x9e3779b97f4a7c15ULL) >> (64 - bits_dedup)];
+}
+
+// Uma entrada ocupada conta enquanto o pedido corre e, depois de concluído,
+// durante VALIDADE_DEDUP segundos
+static inline int dedupVivo(const EntradaDedup *e, time_t agora) {
+    return e->id != 0 && (!e->concluido || agora - e->criado < VALIDADE_DEDUP);
+}
+
+// Procura a entrada viva do pedido id no conjunto (vias e transbordo)
+static EntradaDedup* procurarDedup(ConjuntoDedup *c, uint64_t id, time_t agora) {
+    for (int v = 0; v < VIAS_DEDUP; v++) {
+        if (c->vias[v].id == id && dedupVivo(&c->vias[v], agora))
+            return &c->vias[v];
+    }
+    for (EntradaDedup *e = c->transbordo; e; e = e->prox) {
+        if (e->id == id && dedupVivo(e, agora))
+            return e;
+    }
+    return NULL;
+}
+
+// Devolve à reserva as entradas de transbordo caducadas. Com o mutex do conjunto.
+static void podarDedup(ConjuntoDedup *c, time_t agora) {
+    EntradaDedup **ligacao = &c->transbordo, *caducadas = NULL;
+    int n = 0;
+    while (*ligacao) {
+        EntradaDedup *e = *ligacao;
+        if (!dedupVivo(e, agora)) {
+            *ligacao = e->prox;
+            e->prox = caducadas;
+            caducadas = e;
+            n++;
+        } else {
+            ligacao = &e->prox;
+        }
+    }
+    if (!caducadas)
+        return;
+    c->n_transbordo -= n;
+    atomic_fetch_sub(&dedup_transbordo, n);
+    pthread_mutex_lock(&reserva_dedup_mutex);
+    while (caducadas) {
+        EntradaDedup *e = caducadas;
+        caducadas = e->prox;
+        e->prox = livres_dedup;
+        livres_dedup = e;
+    }
+    pthread_mutex_unlock(&reserva_dedup_mutex);
+}
+
+static EntradaDedup* tirarReservaDedup(void) {
+    pthread_mutex_lock(&reserva_dedup_mutex);
+    EntradaDedup *e = livres_dedup;
+    if (e)
+        livres_dedup = e->prox;
+    pthread_mutex_unlock(&reserva_dedup_mutex);
+    return e;
+}
+
+// Uma entrada só se despeja com o resultado final: a de uma reserva na lista
+// de espera ainda vai receber o lugar
+static inline int despejavel(const EntradaDedup *e) {
+    return e->concluido && e->resultado.codigo != RESULTADO_EM_ESPERA;
+}
+
+// Lugar para um pedido novo: via livre ou caducada, senão uma entrada da
+// reserva no transbordo. Com o transbordo do conjunto no máximo ou a reserva
+// vazia, a entrada despejável mais antiga; NULL se nenhuma o é.
+static EntradaDedup* lugarDedup(ConjuntoDedup *c, time_t agora) {
+    for (int v = 0; v < VIAS_DEDUP; v++) {
+        if (!dedupVivo(&c->vias[v], agora))
+            return &c->vias[v];
+    }
+    podarDedup(c, agora);
+    EntradaDedup *e = c->n_transbordo < MAX_TRANSBORDO_DEDUP ? tirarReservaDedup() : NULL;
+    if (e) {
+        e->prox = c->transbordo;
+        c->transbordo = e;
+        c->n_transbordo++;
+        long n = atomic_fetch_add(&dedup_transbordo, 1) + 1;
+        long maximo = atomic_load(&dedup_transbordo_max);
+        while (n > maximo && !atomic_compare_exchange_weak(&dedup_transbordo_max, &maximo, n))
+            ;
+        return e;
+    }
+    EntradaDedup *alvo = NULL;
+    for (int v = 0; v < VIAS_DEDUP; v++) {
+        if (despejavel(&c->vias[v]) && (!alvo || c->vias[v].criado < alvo->criado))
+            alvo = &c->vias[v];
+    }
+    for (EntradaDedup *t = c->transbordo; t; t = t->prox) {
+        if (despejavel(t) && (!alvo || t->criado < alvo->criado))
+            alvo = t;
+    }
+    if (alvo)
+        atomic_fetch_add(&dedup_despejados, 1);
+    return alvo;
+}
+
+int iniciarPedido(uint64_t id, Resultado *res) {
+    if (id == 0)
+        return 1;
+    ConjuntoDedup *c = conjuntoDedup(id);
+    time_t agora = relogioAgora();
+    pthread_mutex_lock(&c->mutex);
+    for (;;) {
+        EntradaDedup *e = procurarDedup(c, id, agora);
+        if (e && e->concluido) {
+            *res = e->resultado;
+            pthread_mutex_unlock(&c->mutex);
+            atomic_fetch_add(&dedup_repetidos, 1);
+            return 0;
+        }
+        // Pedido novo: fica registado antes de largar o mutex
+        if (!e) {
+            e = lugarDedup(c, agora);
+            if (!e) {
+                pthread_mutex_unlock(&c->mutex);
+                atomic_fetch_add(&dedup_recusados, 1);
+                *res = (Resultado){ RESULTADO_RECUSADO, PNR_INVALIDO };
+                return 0;
+            }
+            e->id = id;
+            e->criado = agora;
+            e->concluido = 0;
+            break;
+        }
+        // O original ainda corre: espera que acabe
+        pthread_cond_wait(&c->concluido, &c->mutex);
+    }
+    pthread_mutex_unlock(&c->mutex);
+    atomic_fetch_add(&dedup_novos, 1);
+    return 1;
+}
+
+void concluirPedido(uint64_t id, Resultado res) {
+    if (id == 0)
+        return;
+    ConjuntoDedup *c = conjuntoDedup(id);
+    pthread_mutex_lock(&c->mutex);
+    EntradaDedup *e = procurarDedup(c, id, relogioAgora());
+    if (e && (!e->concluido || e->resultado.codigo == RESULTADO_EM_ESPERA)) {
+        e->resultado = res;
+        e->concluido = 1;
+    }
+    pthread_cond_broadcast(&c->concluido);
+    pthread_mutex_unlock(&c->mutex);
+}
+
+void imprimirMetricasDedup(void) {
+    printf("Pedidos: %ld novo(s), %ld repetição(ões) respondida(s) da tabela, %ld em transbordo "
+           "(máximo %ld), %ld despejado(s) e %ld recusado(s) com o conjunto cheio\n",
+           atomic_load(&dedup_novos), atomic_load(&dedup_repetidos), atomic_load(&dedup_transbordo),
+           atomic_load(&dedup_transbordo_max), atomic_load(&dedup_despejados), atomic_load(&dedup_recusados));
+}
@@ -0,0 +1,45 @@
+// Cada reserva, pagamento e cancelamento traz o ID do pedido do cliente. O
+// resultado fica numa tabela (conjuntos de VIAS_DEDUP entradas, escolhido o
+// conjunto pelo hash do ID), por isso uma repetição (o cliente voltou a tentar
+// depois de um timeout) recebe o resultado original em O(1), sem tocar no
+// armazenamento nem no seu mutex. Cada conjunto tem o seu mutex. As entradas
+// caducam ao fim de VALIDADE_DEDUP segundos e só então se reaproveitam. A
+// tabela é dimensionada para taxa_dedup pedidos por segundo durante
+// VALIDADE_DEDUP (--taxa-pedidos); num conjunto com as vias todas em validade
+// as entradas seguintes vão para um transbordo de até MAX_TRANSBORDO_DEDUP
+// entradas, tiradas de uma reserva alocada com a tabela: nenhum pedido aloca
+// memória. Com o transbordo cheio despeja-se a entrada concluída mais antiga
+// do conjunto (uma repetição desse pedido volta a ser executada) e, se todas
+// têm pedidos a correr ou reservas na lista de espera, o pedido novo é
+// recusado com RESULTADO_RECUSADO.
+// Compilar com o programa: make (ver Makefile)
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+
+#include "projeto.h"
+
+#define VALIDADE_DEDUP 300
+#define TAXA_DEDUP 100          // pedidos por segundo previstos, por omissão
+
+extern long taxa_dedup;         // --taxa-pedidos
+
+// Aloca a tabela para taxa_dedup pedidos por segundo. Retorna 0 em caso de sucesso.
+int abrirDedup(void);
+
+// Regista o pedido id. Retorna 1 se é novo: o chamador executa-o e chama
+// concluirPedido. Retorna 0 se é uma repetição, com o resultado original em
+// *res (se o original ainda está a correr, espera por ele), ou se não há
+// lugar para ele no conjunto, com RESULTADO_RECUSADO em *res.
+int iniciarPedido(uint64_t id, Resultado *res);
+
+// Guarda o resultado do pedido id e acorda as repetições que esperavam por ele.
+// Uma reserva que entrou na lista de espera conclui-se primeiro com
+// RESULTADO_EM_ESPERA (as repetições recebem-no logo, sem esperar pelo lugar)
+// e depois, uma segunda vez, com o resultado final.
+void concluirPedido(uint64_t id, Resultado res);
+
+void imprimirMetricasDedup(void);
+
+#endif
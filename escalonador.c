@@ -0,0 +1,103 @@
+#include "projeto.h"
+#include "escalonador.h"
+
+static const char *NOMES_CLASSES[N_CLASSES] = { "pagamento", "cancelamento", "reserva", "consulta" };
+
+typedef struct Espera {
+    int classe;
+    int64_t chave;            // ms do relógio
+    int64_t chegada;          // ms reais (envelhecimento e métricas)
+    int concedida;
+    pthread_cond_t cond;
+    struct Espera *prox;
+} Espera;
+
+static pthread_mutex_t escalonador_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Espera *em_espera = NULL; // por ordem de chegada
+int vagas_escalonador = VAGAS_POR_OMISSAO;
+static int vagas_ocupadas = 0;
+
+static atomic_long concedidas_classe[N_CLASSES], espera_total_ms[N_CLASSES], espera_max_ms[N_CLASSES];
+static atomic_long promocoes = 0; // vagas ganhas graças ao envelhecimento
+
+static inline int classeEfetiva(const Espera *e, int64_t agora) {
+    int64_t subidas = (agora - e->chegada) / ENVELHECIMENTO_MS;
+    return subidas >= e->classe ? 0 : e->classe - (int)subidas;
+}
+
+static void registarConcessao(int classe, int64_t espera) {
+    atomic_fetch_add(&concedidas_classe[classe], 1);
+    atomic_fetch_add(&espera_total_ms[classe], espera);
+    long maximo = atomic_load(&espera_max_ms[classe]);
+    while (espera > maximo && !atomic_compare_exchange_weak(&espera_max_ms[classe], &maximo, espera))
+        ;
+}
+
+void entrarEscalonador(int classe, int64_t chave) {
+    pthread_mutex_lock(&escalonador_mutex);
+    if (vagas_ocupadas < vagas_escalonador && em_espera == NULL) {
+        vagas_ocupadas++;
+        pthread_mutex_unlock(&escalonador_mutex);
+        registarConcessao(classe, 0);
+        return;
+    }
+    Espera eu = { .classe = classe, .chave = chave, .chegada = agoraMs(), .concedida = 0, .prox = NULL };
+    pthread_cond_init(&eu.cond, NULL);
+    Espera **fim = &em_espera;
+    while (*fim)
+        fim = &(*fim)->prox;
+    *fim = &eu;
+    while (!eu.concedida)
+        pthread_cond_wait(&eu.cond, &escalonador_mutex);
+    pthread_mutex_unlock(&escalonador_mutex);
+    pthread_cond_destroy(&eu.cond);
+    registarConcessao(classe, agoraMs() - eu.chegada);
+}
+
+void sairEscalonador(void) {
+    pthread_mutex_lock(&escalonador_mutex);
+    int64_t agora = agoraMs();
+    Espera **melhor = NULL;
+    int melhor_classe = N_CLASSES;
+    for (Espera **e = &em_espera; *e; e = &(*e)->prox) {
+        int c = classeEfetiva(*e, agora);
+        if (c < melhor_classe || (c == melhor_classe && (*e)->chave < (*melhor)->chave)) {
+            melhor = e;
+            melhor_classe = c;
+        }
+    }
+    if (melhor) {
+        Espera *escolhida = *melhor;
+        *melhor = escolhida->prox;
+        if (melhor_classe < escolhida->classe)
+            atomic_fetch_add(&promocoes, 1);
+        escolhida->concedida = 1; // a vaga passa diretamente, sem mudar vagas_ocupadas
+        pthread_cond_signal(&escolhida->cond);
+    } else {
+        vagas_ocupadas--;
+    }
+    pthread_mutex_unlock(&escalonador_mutex);
+}
+
+int operacoesEmEspera(void) {
+    int n = 0;
+    pthread_mutex_lock(&escalonador_mutex);
+    for (Espera *e = em_espera; e; e = e->prox)
+        n++;
+    pthread_mutex_unlock(&escalonador_mutex);
+    return n;
+}
+
+long promocoesEscalonador(void) {
+    return atomic_load(&promocoes);
+}
+
+void imprimirMetricasEscalonador(void) {
+    printf("Escalonador (%d vagas, %ld promoção(ões) por espera):", vagas_escalonador, atomic_load(&promocoes));
+    for (int c = 0; c < N_CLASSES; c++) {
+        long n = atomic_load(&concedidas_classe[c]);
+        printf(" %s %ld (média %ld ms, máx %ld ms)%s", NOMES_CLASSES[c], n,
+               n ? atomic_load(&espera_total_ms[c]) / n : 0, atomic_load(&espera_max_ms[c]),
+               c + 1 < N_CLASSES ? ";" : "\n");
+    }
+}
@@ -0,0 +1,34 @@
+// Cada operação ocupa uma de vagas_escalonador vagas antes de tocar no
+// armazenamento. Quando estão todas ocupadas, a vaga que se liberta
+// vai para a operação em espera de classe mais prioritária (pagamento >
+// cancelamento > reserva > consulta). Dentro da mesma classe ganha a menor
+// chave: para os pagamentos é o prazo da reserva que vão pagar (salvá-la
+// antes do ceifeiro), para as outras é o instante de chegada. Contra a fome,
+// uma operação sobe uma classe por cada ENVELHECIMENTO_MS que passa à espera.
+// Compilar com o programa: make (ver Makefile)
+#ifndef ESCALONADOR_H
+#define ESCALONADOR_H
+
+#include <stdint.h>
+
+#define VAGAS_POR_OMISSAO 4
+#define ENVELHECIMENTO_MS 250
+
+enum { CLASSE_PAGAMENTO = 0, CLASSE_CANCELAMENTO, CLASSE_RESERVA, CLASSE_CONSULTA, N_CLASSES };
+
+extern int vagas_escalonador;   // --vagas
+
+// Ocupa uma vaga para uma operação da classe indicada, esperando pela sua vez.
+// chave em ms do relógio (menor passa primeiro dentro da classe).
+void entrarEscalonador(int classe, int64_t chave);
+
+// Liberta a vaga: passa-a à melhor operação em espera ou devolve-a
+void sairEscalonador(void);
+
+// Operações à espera de uma vaga, e vagas ganhas até agora graças ao envelhecimento
+int operacoesEmEspera(void);
+long promocoesEscalonador(void);
+
+void imprimirMetricasEscalonador(void);
+
+#endif
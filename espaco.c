@@ -9,6 +9,8 @@
 #include <termios.h>
 #include <fcntl.h>
 
+#include "controlo.h"
+
 #define INICIAL 10 // n de Threads/"clientes"
 
 typedef struct {
@@ -29,7 +31,6 @@ void* consulta(void* args);
 void ver_dados();
 void* Thread(void* args);
 void tratamento_interrupcao();
-void verificar_interrupcao();
 
 volatile int exibir_dados_periodicamente = 1;  // Flag para controle
 
@@ -40,7 +41,9 @@ void configurar_terminal(int enable) {
 
     if (enable) {
         t.c_lflag &= ~(ICANON | ECHO); // Desativa buffer de linha e eco
-        t.c_cc[VMIN] = 0;
+        // Quem espera pelo teclado é o poll() da thread de controlo; com
+        // VMIN = 1 um read() que devolve 0 é mesmo o fim do stdin
+        t.c_cc[VMIN] = 1;
         t.c_cc[VTIME] = 0;
     } else {
         t.c_lflag |= (ICANON | ECHO); // Restaura configuração padrão
@@ -68,6 +71,11 @@ int main() {
 
     configurar_terminal(1);  // Configurar terminal para leitura não bloqueante
 
+    if (iniciar_controlo("espaco") != 0) {
+        configurar_terminal(0);
+        return 1;
+    }
+
     for (i = 0; i < INICIAL; i++) {
         intptr_t buffer_index = i;
         pthread_create(&threads[i], NULL, Thread, (void*)buffer_index);
@@ -77,6 +85,9 @@ int main() {
         pthread_join(threads[i], NULL);
     }
 
+    // Todos os clientes terminaram: pede a thread de controlo para sair
+    terminar_controlo();
+
     configurar_terminal(0);  // Restaurar terminal
 
     // Liberação da memória alocada dinamicamente
@@ -92,6 +103,10 @@ int main() {
 void* reserva(void* args) {
     sem_wait(&sem_reserva);
     tratamento_interrupcao();  // Simula interrupção durante a operação
+    if (atomic_load(&estado_global) == ENCERRAR) { // encerramento: não escreve mais nada
+        sem_post(&sem_reserva);
+        return NULL;
+    }
 
     int buf_index = (intptr_t)args;
     int pnr = (unsigned int)pthread_self();
@@ -113,6 +128,10 @@ void* reserva(void* args) {
 void* consulta(void* args) {
     sem_wait(&sem_consulta);
     tratamento_interrupcao();  // Simula interrupção durante a operação
+    if (atomic_load(&estado_global) == ENCERRAR) { // encerramento: não escreve mais nada
+        sem_post(&sem_consulta);
+        return NULL;
+    }
 
     int buf_index = (intptr_t)args;
     int pnr = (unsigned int)pthread_self();
@@ -145,8 +164,7 @@ void ver_dados() {
 void* Thread(void* args) {
     int index = (intptr_t)args;
     int i;
-    for (i = 0; i < 5; i++) {
-        verificar_interrupcao();
+    for (i = 0; i < 5 && verificar_interrupcao(); i++) {
         int f = rand() % 2;
         pthread_t thread;
 
@@ -166,12 +184,3 @@ void* Thread(void* args) {
 void tratamento_interrupcao() {
     sleep(1);  // Simula uma "interrupção" do processo, com uma pausa de 1 segundo
 }
-
-// Verifica se a barra de espaço foi pressionada
-void verificar_interrupcao() {
-    char c;
-    if (read(STDIN_FILENO, &c, 1) > 0 && c == ' ') {
-        printf("\n[Interrupção] Barra de espaço pressionada. Pausando por 5 segundos...\n");
-        sleep(5);
-    }
-}
@@ -0,0 +1,323 @@
+#include "projeto.h"
+#include "executor.h"
+
+#define CAPACIDADE_DEQUE 1024
+
+typedef struct Tarefa {
+    void* (*func)(void*);
+    void *arg;
+    struct Tarefa *prox;      // na fila de injeção
+} Tarefa;
+
+typedef struct {
+    atomic_long topo, fundo;
+    _Atomic(Tarefa*) deque[CAPACIDADE_DEQUE];
+    pthread_mutex_t injecao_mutex;
+    Tarefa *injecao_inicio, *injecao_fim;
+    atomic_int n_injecao;     // lido sem bloqueio por quem procura trabalho
+    atomic_long executadas, roubadas;
+    pthread_t thread;
+    struct Executor *ex;
+    int id;
+} Trabalhador;
+
+struct Executor {
+    int n;
+    int fila_unica;
+    Trabalhador *trabalhadores;
+    atomic_long pendentes;    // submetidas e ainda por começar
+    atomic_long por_concluir; // submetidas e ainda por acabar
+    atomic_int adormecidos, parar;
+    pthread_mutex_t mutex;
+    pthread_cond_t acordar, concluido;
+};
+
+static __thread Trabalhador *trabalhador_atual = NULL;
+Executor *executor = NULL;    // executor das operações
+int n_trabalhadores = TRABALHADORES_POR_OMISSAO;
+
+// Só o dono. Retorna 0 se a deque está cheia.
+static int dequeColocar(Trabalhador *t, Tarefa *x) {
+    long b = atomic_load_explicit(&t->fundo, memory_order_relaxed);
+    long topo = atomic_load_explicit(&t->topo, memory_order_acquire);
+    if (b - topo >= CAPACIDADE_DEQUE)
+        return 0;
+    atomic_store_explicit(&t->deque[b % CAPACIDADE_DEQUE], x, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&t->fundo, b + 1, memory_order_relaxed);
+    return 1;
+}
+
+// Só o dono: retira a tarefa mais recente
+static Tarefa* dequeRetirar(Trabalhador *t) {
+    long b = atomic_load_explicit(&t->fundo, memory_order_relaxed) - 1;
+    atomic_store_explicit(&t->fundo, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long topo = atomic_load_explicit(&t->topo, memory_order_relaxed);
+    if (topo > b) { // vazia
+        atomic_store_explicit(&t->fundo, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    Tarefa *x = atomic_load_explicit(&t->deque[b % CAPACIDADE_DEQUE], memory_order_relaxed);
+    if (topo == b) { // última: disputa com os ladrões
+        if (!atomic_compare_exchange_strong_explicit(&t->topo, &topo, topo + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed))
+            x = NULL;
+        atomic_store_explicit(&t->fundo, b + 1, memory_order_relaxed);
+    }
+    return x;
+}
+
+// Qualquer thread: rouba a tarefa mais antiga
+static Tarefa* dequeRoubar(Trabalhador *t) {
+    long topo = atomic_load_explicit(&t->topo, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&t->fundo, memory_order_acquire);
+    if (topo >= b)
+        return NULL;
+    Tarefa *x = atomic_load_explicit(&t->deque[topo % CAPACIDADE_DEQUE], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&t->topo, &topo, topo + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+        return NULL; // outro ladrão (ou o dono) ficou com ela
+    return x;
+}
+
+static void injetar(Trabalhador *t, Tarefa *x) {
+    x->prox = NULL;
+    pthread_mutex_lock(&t->injecao_mutex);
+    if (t->injecao_fim)
+        t->injecao_fim->prox = x;
+    else
+        t->injecao_inicio = x;
+    t->injecao_fim = x;
+    atomic_fetch_add(&t->n_injecao, 1);
+    pthread_mutex_unlock(&t->injecao_mutex);
+}
+
+static Tarefa* retirarInjecao(Trabalhador *t) {
+    if (atomic_load_explicit(&t->n_injecao, memory_order_relaxed) == 0)
+        return NULL;
+    pthread_mutex_lock(&t->injecao_mutex);
+    Tarefa *x = t->injecao_inicio;
+    if (x) {
+        t->injecao_inicio = x->prox;
+        if (!t->injecao_inicio)
+            t->injecao_fim = NULL;
+        atomic_fetch_sub(&t->n_injecao, 1);
+    }
+    pthread_mutex_unlock(&t->injecao_mutex);
+    return x;
+}
+
+int executorSubmeter(Executor *ex, int w, void* (*func)(void*), void *arg) {
+    if (!ex)
+        return -1;
+    Tarefa *x = malloc(sizeof(Tarefa));
+    if (!x) {
+        perror("Erro ao alocar memória");
+        return -1;
+    }
+    x->func = func;
+    x->arg = arg;
+    atomic_fetch_add(&ex->por_concluir, 1);
+    atomic_fetch_add(&ex->pendentes, 1);
+    Trabalhador *t = trabalhador_atual;
+    if (ex->fila_unica)
+        injetar(&ex->trabalhadores[0], x);
+    else if (!(t && t->ex == ex && dequeColocar(t, x)))
+        injetar(&ex->trabalhadores[w % ex->n], x);
+    // pendentes sobe antes de ler adormecidos e o trabalhador faz o inverso,
+    // por isso pelo menos um dos dois vê o outro
+    if (atomic_load(&ex->adormecidos) > 0) {
+        pthread_mutex_lock(&ex->mutex);
+        pthread_cond_signal(&ex->acordar);
+        pthread_mutex_unlock(&ex->mutex);
+    }
+    return 0;
+}
+
+void executorSeguimento(void* (*func)(void*), void *arg) {
+    if (executorSubmeter(trabalhador_atual->ex, trabalhador_atual->id, func, arg) != 0)
+        func(arg);
+}
+
+static Tarefa* procurarTarefa(Trabalhador *t) {
+    Executor *ex = t->ex;
+    Tarefa *x;
+    if (ex->fila_unica)
+        return retirarInjecao(&ex->trabalhadores[0]);
+    if ((x = dequeRetirar(t)) || (x = retirarInjecao(t)))
+        return x;
+    for (int tentativa = 0; tentativa < ex->n; tentativa++) {
+        Trabalhador *vitima = &ex->trabalhadores[aleatorio(ex->n)];
+        if (vitima == t)
+            continue;
+        if ((x = dequeRoubar(vitima)) || (x = retirarInjecao(vitima))) {
+            atomic_fetch_add_explicit(&t->roubadas, 1, memory_order_relaxed);
+            return x;
+        }
+    }
+    return NULL;
+}
+
+static void* trabalhador_thread(void* arg) {
+    Trabalhador *t = arg;
+    Executor *ex = t->ex;
+    trabalhador_atual = t;
+    for (;;) {
+        Tarefa *x = procurarTarefa(t);
+        if (x) {
+            atomic_fetch_sub(&ex->pendentes, 1);
+            x->func(x->arg);
+            free(x);
+            atomic_fetch_add_explicit(&t->executadas, 1, memory_order_relaxed);
+            if (atomic_fetch_sub(&ex->por_concluir, 1) == 1) {
+                pthread_mutex_lock(&ex->mutex);
+                pthread_cond_broadcast(&ex->concluido);
+                pthread_mutex_unlock(&ex->mutex);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&ex->mutex);
+        atomic_fetch_add(&ex->adormecidos, 1);
+        while (atomic_load(&ex->pendentes) == 0 && !atomic_load(&ex->parar))
+            pthread_cond_wait(&ex->acordar, &ex->mutex);
+        atomic_fetch_sub(&ex->adormecidos, 1);
+        int sair = atomic_load(&ex->parar) && atomic_load(&ex->pendentes) == 0;
+        pthread_mutex_unlock(&ex->mutex);
+        if (sair)
+            break;
+    }
+    return NULL;
+}
+
+Executor* executorCriar(int n, int fila_unica, int fixar) {
+    Executor *ex = calloc(1, sizeof(Executor));
+    if (!ex) {
+        perror("Erro ao alocar o executor");
+        return NULL;
+    }
+    ex->n = n;
+    ex->fila_unica = fila_unica;
+    ex->trabalhadores = calloc(n, sizeof(Trabalhador));
+    if (!ex->trabalhadores) {
+        perror("Erro ao alocar os trabalhadores");
+        free(ex);
+        return NULL;
+    }
+    pthread_mutex_init(&ex->mutex, NULL);
+    pthread_cond_init(&ex->acordar, NULL);
+    pthread_cond_init(&ex->concluido, NULL);
+    for (int w = 0; w < n; w++) {
+        ex->trabalhadores[w].ex = ex;
+        ex->trabalhadores[w].id = w;
+        pthread_mutex_init(&ex->trabalhadores[w].injecao_mutex, NULL);
+    }
+    for (int w = 0; w < n; w++) {
+        pthread_attr_t attr;
+        if (fixar)
+            atributosOperacao(&attr, w % n_particoes);
+        else
+            pthread_attr_init(&attr);
+        pthread_create(&ex->trabalhadores[w].thread, &attr, trabalhador_thread, &ex->trabalhadores[w]);
+        pthread_attr_destroy(&attr);
+    }
+    return ex;
+}
+
+void executorEsperar(Executor *ex) {
+    if (!ex)
+        return;
+    pthread_mutex_lock(&ex->mutex);
+    while (atomic_load(&ex->por_concluir) > 0)
+        pthread_cond_wait(&ex->concluido, &ex->mutex);
+    pthread_mutex_unlock(&ex->mutex);
+}
+
+void executorParar(Executor *ex) {
+    if (!ex)
+        return;
+    executorEsperar(ex);
+    pthread_mutex_lock(&ex->mutex);
+    atomic_store(&ex->parar, 1);
+    pthread_cond_broadcast(&ex->acordar);
+    pthread_mutex_unlock(&ex->mutex);
+    for (int w = 0; w < ex->n; w++) {
+        pthread_join(ex->trabalhadores[w].thread, NULL);
+        pthread_mutex_destroy(&ex->trabalhadores[w].injecao_mutex);
+    }
+    pthread_mutex_destroy(&ex->mutex);
+    pthread_cond_destroy(&ex->acordar);
+    pthread_cond_destroy(&ex->concluido);
+    free(ex->trabalhadores);
+    free(ex);
+}
+
+int trabalhadorDaParticao(int p) {
+    return p % n_trabalhadores;
+}
+
+void imprimirMetricasExecutor(void) {
+    if (!executor)
+        return;
+    printf("Executor (%d trabalhadores):", executor->n);
+    for (int w = 0; w < executor->n; w++)
+        printf(" %d:%ld/%ld", w, atomic_load(&executor->trabalhadores[w].executadas),
+               atomic_load(&executor->trabalhadores[w].roubadas));
+    printf(" (executadas/roubadas)\n");
+}
+
+// --bench-executor: árvores de tarefas sintéticas (cada tarefa faz um pouco
+// de trabalho e cria duas de seguimento até PROFUNDIDADE_BENCH), no executor
+// com roubo e no pool de fila única, de 1 a MAX_TRABALHADORES trabalhadores
+#define RAIZES_BENCH 4096
+#define PROFUNDIDADE_BENCH 4
+#define TRABALHO_BENCH 256
+
+static atomic_ulong soma_bench = 0;
+
+static void* tarefaBench(void* arg) {
+    int profundidade = (intptr_t)arg;
+    uint64_t soma = 0;
+    for (int k = 0; k < TRABALHO_BENCH; k++)
+        soma += proximoAleatorio(geradorThread());
+    atomic_fetch_add_explicit(&soma_bench, soma, memory_order_relaxed);
+    if (profundidade > 0) {
+        executorSeguimento(tarefaBench, (void*)(intptr_t)(profundidade - 1));
+        executorSeguimento(tarefaBench, (void*)(intptr_t)(profundidade - 1));
+    }
+    return NULL;
+}
+
+// Tarefas por segundo com n trabalhadores
+static double medirExecutor(int n, int fila_unica, long *roubadas) {
+    Executor *ex = executorCriar(n, fila_unica, 0);
+    if (!ex)
+        return 0;
+    int64_t inicio = agoraNs();
+    for (int r = 0; r < RAIZES_BENCH; r++) {
+        if (executorSubmeter(ex, r, tarefaBench, (void*)(intptr_t)PROFUNDIDADE_BENCH) != 0)
+            break;
+    }
+    executorEsperar(ex);
+    int64_t duracao = agoraNs() - inicio;
+    long total = 0;
+    *roubadas = 0;
+    for (int w = 0; w < n; w++) {
+        total += atomic_load(&ex->trabalhadores[w].executadas);
+        *roubadas += atomic_load(&ex->trabalhadores[w].roubadas);
+    }
+    executorParar(ex);
+    return total * 1e9 / duracao;
+}
+
+void benchExecutor(void) {
+    printf("%d tarefas por medição\n", RAIZES_BENCH * ((2 << PROFUNDIDADE_BENCH) - 1));
+    printf("trabalhadores  roubo (tarefas/s)  roubadas  fila única (tarefas/s)\n");
+    for (int n = 1; n <= MAX_TRABALHADORES; n *= 2) {
+        long roubadas, nada;
+        double roubo = medirExecutor(n, 0, &roubadas);
+        double unica = medirExecutor(n, 1, &nada);
+        printf("%13d  %17.0f  %8ld  %22.0f\n", n, roubo, roubadas, unica);
+    }
+}
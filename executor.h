@@ -0,0 +1,53 @@
+// As operações correm num conjunto fixo de trabalhadores em vez de uma thread
+// por operação. Cada trabalhador tem uma deque (Chase-Lev): o dono coloca e
+// retira no fundo, os outros roubam do topo. Os pedidos vindos de fora
+// (main, ceifeiro) entram pela fila de injeção do trabalhador dono da
+// partição do PNR, que corre nos CPUs dessa partição; as tarefas de
+// seguimento criadas dentro de uma tarefa ficam na deque de quem as criou.
+// Um trabalhador sem trabalho rouba de vítimas ao acaso e, se não houver
+// nada pendente, adormece. Com fila_unica todos usam só a fila de injeção
+// do trabalhador 0 (o pool de fila única, usado como referência em
+// --bench-executor).
+// Compilar com o programa: make (ver Makefile)
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#define TRABALHADORES_POR_OMISSAO 4
+#define MAX_TRABALHADORES 64
+
+typedef struct Executor Executor;
+
+extern Executor *executor;    // executor das operações
+extern int n_trabalhadores;   // --trabalhadores
+
+// Cria um executor com n trabalhadores. Com fixar, o trabalhador w corre nos
+// CPUs da partição w (a que recebe os seus pedidos). Retorna NULL se não houver
+// memória; as funções seguintes aceitam um executor NULL.
+Executor* executorCriar(int n, int fila_unica, int fixar);
+
+// Submete func(arg). Dentro de um trabalhador deste executor fica na sua
+// deque (seguimento); de fora entra pela fila do trabalhador w.
+// Retorna -1, sem submeter nada, se não houver executor ou memória para a
+// tarefa: o chamador corre então func(arg) ele mesmo
+int executorSubmeter(Executor *ex, int w, void* (*func)(void*), void *arg);
+
+// Tarefa de seguimento, a partir de uma tarefa em curso; sem memória para a
+// pôr na fila, corre já neste trabalhador
+void executorSeguimento(void* (*func)(void*), void *arg);
+
+// Espera que todas as tarefas submetidas (e os seus seguimentos) acabem
+void executorEsperar(Executor *ex);
+
+// Espera pelas tarefas, pára os trabalhadores e liberta o executor
+void executorParar(Executor *ex);
+
+// Trabalhador que recebe os pedidos da partição p
+int trabalhadorDaParticao(int p);
+
+void imprimirMetricasExecutor(void);
+
+// --bench-executor: tarefas por segundo no executor com roubo e no pool de
+// fila única, de 1 a MAX_TRABALHADORES trabalhadores
+void benchExecutor(void);
+
+#endif
@@ -0,0 +1,296 @@
+#include "projeto.h"
+#include "indice.h"
+
+#define NIVEIS_INDICE 16
+#define MARCA_INDICE ((uintptr_t)1) // bit 0 do ponteiro seguinte: nó a ser removido
+
+typedef struct NoIndice {
+    int64_t prazo;             // timestamp + PRAZO_PAGAMENTO
+    uint32_t pnr;
+    atomic_int pago;
+    atomic_int refs;           // inseridor + removedor: o último a sair retira o nó
+    int nivel;
+    struct NoIndice *limbo;    // ligação na lista de nós à espera de serem libertados
+    _Atomic uintptr_t prox[];  // um ponteiro (com marca) por nível
+} NoIndice;
+
+#define VAGAS_INDICE 64    // leitores em simultâneo no índice
+#define EPOCAS_LIMBO 3     // limbos: época atual e as duas anteriores
+#define LIMBO_MINIMO 32    // nós à espera antes de se tentar avançar a época
+
+typedef struct {
+    _Alignas(64) atomic_ulong epoca; // época anunciada pelo leitor (0 = vaga livre)
+} VagaIndice;
+
+int indice_ativo = 1;
+static NoIndice *cabeca_indice = NULL;
+static atomic_ulong epoca_indice = 1;
+static VagaIndice vagas_indice[VAGAS_INDICE];
+static _Atomic(NoIndice*) limbo_indice[EPOCAS_LIMBO]; // nós já desligados, por época em que saíram
+static atomic_flag avancando_epoca = ATOMIC_FLAG_INIT;
+static atomic_long tamanho_indice = 0, limbo_pendentes = 0, limbo_max = 0;
+
+static inline NoIndice* ptrIndice(uintptr_t v) { return (NoIndice*)(v & ~MARCA_INDICE); }
+static inline int marcadoIndice(uintptr_t v) { return (int)(v & MARCA_INDICE); }
+
+// 1 se o nó vem antes da chave (prazo, pnr)
+static inline int antesDe(const NoIndice *n, int64_t prazo, uint32_t pnr) {
+    return n->prazo < prazo || (n->prazo == prazo && n->pnr < pnr);
+}
+
+static NoIndice* novoNoIndice(int64_t prazo, uint32_t pnr, int nivel) {
+    NoIndice *n = calloc(1, sizeof(NoIndice) + nivel * sizeof(_Atomic uintptr_t));
+    if (!n)
+        return NULL;
+    n->prazo = prazo;
+    n->pnr = pnr;
+    n->nivel = nivel;
+    atomic_init(&n->refs, 2);
+    return n;
+}
+
+void abrirIndice(void) {
+    indice_ativo = (nome_shm == NULL);
+    cabeca_indice = novoNoIndice(INT64_MIN, 0, NIVEIS_INDICE);
+}
+
+// Nível aleatório com distribuição geométrica (p = 1/2), do gerador da thread
+static int nivelAleatorio(void) {
+    uint32_t x = (uint32_t)proximoAleatorio(geradorThread());
+    int nivel = 1 + __builtin_ctz(x | (1u << (NIVEIS_INDICE - 1)));
+    return nivel;
+}
+
+static void libertarLimbo(NoIndice *lista) {
+    long n = 0;
+    while (lista) {
+        NoIndice *prox = lista->limbo;
+        free(lista);
+        lista = prox;
+        n++;
+    }
+    atomic_fetch_sub(&limbo_pendentes, n);
+}
+
+// Ocupa uma vaga com a época atual e retorna-a. A época é relida depois do
+// anúncio: quem a avança vê o anúncio ou já o novo valor é o anunciado.
+static int entrarIndice(void) {
+    int v = (int)(((uintptr_t)pthread_self() >> 6) % VAGAS_INDICE);
+    for (;; v = (v + 1) % VAGAS_INDICE) {
+        unsigned long livre = 0, e = atomic_load(&epoca_indice);
+        if (atomic_load_explicit(&vagas_indice[v].epoca, memory_order_relaxed) != 0 ||
+            !atomic_compare_exchange_strong(&vagas_indice[v].epoca, &livre, e)) {
+            if (v == VAGAS_INDICE - 1)
+                sched_yield(); // todas ocupadas: os percursos são curtos
+            continue;
+        }
+        unsigned long atual;
+        while ((atual = atomic_load(&epoca_indice)) != e) {
+            atomic_store(&vagas_indice[v].epoca, atual);
+            e = atual;
+        }
+        return v;
+    }
+}
+
+// Avança a época se todos os leitores ativos já estão na atual e liberta os
+// nós retirados há três épocas. Só uma thread de cada vez: entre ver os
+// anúncios e publicar a nova época ninguém pode retirar para esse limbo.
+static void avancarEpocaIndice(void) {
+    if (atomic_flag_test_and_set(&avancando_epoca))
+        return;
+    unsigned long e = atomic_load(&epoca_indice);
+    for (int v = 0; v < VAGAS_INDICE; v++) {
+        unsigned long anunciada = atomic_load(&vagas_indice[v].epoca);
+        if (anunciada != 0 && anunciada != e) {
+            atomic_flag_clear(&avancando_epoca);
+            return;
+        }
+    }
+    NoIndice *lista = atomic_exchange(&limbo_indice[(e + 1) % EPOCAS_LIMBO], NULL);
+    atomic_store(&epoca_indice, e + 1);
+    atomic_flag_clear(&avancando_epoca);
+    libertarLimbo(lista);
+}
+
+static void sairIndice(int vaga) {
+    atomic_store(&vagas_indice[vaga].epoca, 0);
+    if (atomic_load_explicit(&limbo_pendentes, memory_order_relaxed) >= LIMBO_MINIMO)
+        avancarEpocaIndice();
+}
+
+// Larga uma referência; o último dono põe o nó no limbo da época em que o
+// leitor (vaga) entrou
+static void largarNoIndice(NoIndice *n, int vaga) {
+    if (atomic_fetch_sub(&n->refs, 1) != 1)
+        return;
+    _Atomic(NoIndice*) *limbo = &limbo_indice[atomic_load(&vagas_indice[vaga].epoca) % EPOCAS_LIMBO];
+    NoIndice *atual = atomic_load(limbo);
+    do {
+        n->limbo = atual;
+    } while (!atomic_compare_exchange_weak(limbo, &atual, n));
+    long pendentes = atomic_fetch_add(&limbo_pendentes, 1) + 1;
+    long maximo = atomic_load(&limbo_max);
+    while (pendentes > maximo && !atomic_compare_exchange_weak(&limbo_max, &maximo, pendentes))
+        ;
+}
+
+// Procura a posição da chave em todos os níveis, desligando pelo caminho os
+// nós marcados. Retorna 1 se a chave existe (em succs[0]).
+static int procurarIndice(int64_t prazo, uint32_t pnr, NoIndice **preds, NoIndice **succs) {
+recomecar:;
+    NoIndice *pred = cabeca_indice;
+    for (int i = NIVEIS_INDICE - 1; i >= 0; i--) {
+        NoIndice *atual = ptrIndice(atomic_load(&pred->prox[i]));
+        while (atual) {
+            uintptr_t seguinte = atomic_load(&atual->prox[i]);
+            while (marcadoIndice(seguinte)) {
+                uintptr_t esperado = (uintptr_t)atual;
+                if (!atomic_compare_exchange_strong(&pred->prox[i], &esperado, (uintptr_t)ptrIndice(seguinte)))
+                    goto recomecar;
+                atual = ptrIndice(seguinte);
+                if (!atual)
+                    break;
+                seguinte = atomic_load(&atual->prox[i]);
+            }
+            if (!atual || !antesDe(atual, prazo, pnr))
+                break;
+            pred = atual;
+            atual = ptrIndice(seguinte);
+        }
+        preds[i] = pred;
+        succs[i] = atual;
+    }
+    return succs[0] && succs[0]->prazo == prazo && succs[0]->pnr == pnr;
+}
+
+void indiceInserir(int64_t prazo, uint32_t pnr, int pago) {
+    if (!indice_ativo)
+        return;
+    NoIndice *preds[NIVEIS_INDICE], *succs[NIVEIS_INDICE];
+    NoIndice *novo = novoNoIndice(prazo, pnr, nivelAleatorio());
+    if (!novo)
+        return;
+    atomic_init(&novo->pago, pago);
+
+    int vaga = entrarIndice();
+    for (;;) {
+        if (procurarIndice(prazo, pnr, preds, succs)) { // já indexado
+            free(novo);
+            sairIndice(vaga);
+            return;
+        }
+        for (int i = 0; i < novo->nivel; i++)
+            atomic_store(&novo->prox[i], (uintptr_t)succs[i]);
+        uintptr_t esperado = (uintptr_t)succs[0];
+        if (atomic_compare_exchange_strong(&preds[0]->prox[0], &esperado, (uintptr_t)novo))
+            break;
+    }
+    atomic_fetch_add(&tamanho_indice, 1);
+
+    // Níveis superiores: param se o nó entretanto for marcado para remoção
+    for (int i = 1; i < novo->nivel; i++) {
+        for (;;) {
+            uintptr_t esperado = (uintptr_t)succs[i];
+            if (atomic_compare_exchange_strong(&preds[i]->prox[i], &esperado, (uintptr_t)novo))
+                break;
+            if (!procurarIndice(prazo, pnr, preds, succs))
+                goto fim;
+            uintptr_t atual = atomic_load(&novo->prox[i]);
+            if (marcadoIndice(atual) ||
+                !atomic_compare_exchange_strong(&novo->prox[i], &atual, (uintptr_t)succs[i]))
+                goto fim;
+        }
+    }
+fim:
+    // Se foi removido enquanto eram ligados os níveis, garante que fica desligado
+    if (marcadoIndice(atomic_load(&novo->prox[0])))
+        procurarIndice(prazo, pnr, preds, succs);
+    largarNoIndice(novo, vaga);
+    sairIndice(vaga);
+}
+
+void indiceRemover(int64_t prazo, uint32_t pnr) {
+    if (!indice_ativo)
+        return;
+    NoIndice *preds[NIVEIS_INDICE], *succs[NIVEIS_INDICE];
+    int vaga = entrarIndice();
+    if (!procurarIndice(prazo, pnr, preds, succs)) {
+        sairIndice(vaga);
+        return;
+    }
+    NoIndice *no = succs[0];
+    for (int i = no->nivel - 1; i >= 1; i--)
+        atomic_fetch_or(&no->prox[i], MARCA_INDICE);
+    // Quem marca o nível 0 é o dono da remoção
+    if (!marcadoIndice(atomic_fetch_or(&no->prox[0], MARCA_INDICE))) {
+        procurarIndice(prazo, pnr, preds, succs); // desliga-o de todos os níveis
+        atomic_fetch_sub(&tamanho_indice, 1);
+        largarNoIndice(no, vaga);
+    }
+    sairIndice(vaga);
+}
+
+void indiceMarcarPago(int64_t prazo, uint32_t pnr) {
+    if (!indice_ativo)
+        return;
+    NoIndice *preds[NIVEIS_INDICE], *succs[NIVEIS_INDICE];
+    int vaga = entrarIndice();
+    if (procurarIndice(prazo, pnr, preds, succs))
+        atomic_store(&succs[0]->pago, 1);
+    sairIndice(vaga);
+}
+
+int indiceIntervalo(int64_t de, int64_t ate, void (*funcao)(int64_t prazo, uint32_t pnr, int pago, void *ctx), void *ctx) {
+    NoIndice *preds[NIVEIS_INDICE], *succs[NIVEIS_INDICE];
+    int n = 0;
+    if (!indice_ativo)
+        return 0;
+    int vaga = entrarIndice();
+    procurarIndice(de, 0, preds, succs);
+    for (NoIndice *atual = succs[0]; atual && atual->prazo <= ate; ) {
+        uintptr_t seguinte = atomic_load(&atual->prox[0]);
+        if (!marcadoIndice(seguinte)) {
+            if (funcao)
+                funcao(atual->prazo, atual->pnr, atomic_load(&atual->pago), ctx);
+            n++;
+        }
+        atual = ptrIndice(seguinte);
+    }
+    sairIndice(vaga);
+    return n;
+}
+
+void fecharIndice(void) {
+    NoIndice *atual = cabeca_indice;
+    while (atual) {
+        NoIndice *prox = ptrIndice(atomic_load(&atual->prox[0]));
+        free(atual);
+        atual = prox;
+    }
+    for (int e = 0; e < EPOCAS_LIMBO; e++)
+        libertarLimbo(atomic_exchange(&limbo_indice[e], NULL));
+    cabeca_indice = NULL;
+}
+
+// Mostra um PNR por pagar encontrado no intervalo
+static void mostrarPorPagar(int64_t prazo, uint32_t pnr, int pago, void *ctx) {
+    if (!pago) {
+        printf(" %s(%lds)", textoPNR(pnr).texto, (long)(prazo - *(time_t*)ctx));
+    }
+}
+
+void relatorioPrazos(void) {
+    if (!indice_ativo)
+        return;
+    time_t agora = relogioAgora();
+    printf("=== Índice por prazo (%ld reservas) ===\n", atomic_load(&tamanho_indice));
+    printf("Época %lu, %ld nó(s) removido(s) à espera de libertação (máximo %ld)\n",
+           atomic_load(&epoca_indice), atomic_load(&limbo_pendentes), atomic_load(&limbo_max));
+    printf("Por pagar a expirar nos próximos 10 s:");
+    indiceIntervalo(agora, agora + 10, mostrarPorPagar, &agora);
+    printf("\n");
+    // Prazo = momento da reserva + PRAZO_PAGAMENTO, por isso a mesma ordem serve
+    int recentes = indiceIntervalo(agora - 30 + PRAZO_PAGAMENTO, agora + PRAZO_PAGAMENTO, NULL, NULL);
+    printf("Reservas feitas nos últimos 30 s: %d\n", recentes);
+}
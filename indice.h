@@ -0,0 +1,38 @@
+// Skip list sem bloqueios (marcação do ponteiro seguinte, à Harris/Fraser) com
+// todas as reservas vivas ordenadas por (prazo, pnr). Permite perguntas por
+// intervalo ("por pagar a expirar nos próximos 10 s", "feitas entre T1 e T2")
+// sem bloquear as partições nem as inserções de adicionarReserva.
+// O índice é do processo: no modo --shm outros processos alteram as partições
+// sem o atualizar, por isso aí fica desativado.
+// Os nós desligados libertam-se por épocas: cada leitor anuncia, numa vaga,
+// a época global em que entrou; um nó retirado na época e vai para o limbo
+// dessa época e só é libertado quando a época passa a e + 3, o que exige que
+// todos os leitores ativos já tenham entrado em e + 2 (nenhum o pode ver).
+// Como os percursos são curtos, a época avança sempre e o limbo fica limitado
+// às três últimas épocas, mesmo com leitores sempre presentes.
+// Compilar com o programa: make (ver Makefile)
+#ifndef INDICE_H
+#define INDICE_H
+
+#include <stdint.h>
+
+// 0 no modo --shm (definido por abrirIndice); as funções não fazem nada
+extern int indice_ativo;
+
+void abrirIndice(void);
+void fecharIndice(void);
+
+// Acrescenta, retira ou marca como paga a reserva (prazo, pnr). Sem bloqueios;
+// chamadas com a partição do PNR bloqueada, pela mesma ordem que o armazenamento.
+void indiceInserir(int64_t prazo, uint32_t pnr, int pago);
+void indiceRemover(int64_t prazo, uint32_t pnr);
+void indiceMarcarPago(int64_t prazo, uint32_t pnr);
+
+// Percorre por ordem as reservas com prazo em [de, ate] e chama funcao (se
+// não for NULL) para cada uma. Retorna o número de reservas visitadas.
+int indiceIntervalo(int64_t de, int64_t ate, void (*funcao)(int64_t prazo, uint32_t pnr, int pago, void *ctx), void *ctx);
+
+// Relatório feito só com o índice, sem bloquear nenhuma partição
+void relatorioPrazos(void);
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -5,6 +6,13 @@
 #include <semaphore.h>
 #include <time.h>
 #include <stdint.h>
+#include <sched.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <signal.h>
+
+#include "trinco.h"
+#include "aleatorio.h"
 
 #define INICIAL 10 // nº de Threads/"clientes"
 #define TRUE 1
@@ -18,7 +26,20 @@ typedef struct {
 
 buffer *regicao_critica;  // Mudança para alocação dinâmica
 
-pthread_mutex_t mutex;
+// Gerador xoshiro256** por cliente (aleatorio.h), em vez do rand()
+// partilhado. O main semeia o gerador base e dá a cada cliente, pela ordem de
+// criação, um fluxo independente (salto de 2^128 passos), por isso com
+// --semente N a execução de cada cliente é reproduzível.
+Aleatorio fluxos[INICIAL];
+
+// Com --virtual as pausas de tratamento_interrupcao não esperam: só somam o
+// tempo que teriam demorado
+int relogio_virtual = 0;
+atomic_long segundos_virtuais = 0;
+
+// Trinco da região crítica (trinco.h): gira um pouco antes de dormir no
+// futex e guarda o perfil de contenção. kill -USR1 imprime o perfil.
+Trinco mutex = TRINCO_INICIAL;
 sem_t sem_reserva;
 sem_t sem_consulta;
 
@@ -27,14 +48,33 @@ void* consulta(void* args);
 void* cancelamento(void* args);
 
 void ver_dados();
+void imprimir_perfil();
+#define bloquear(t) trincoBloquear((t), NULL, __func__, __LINE__)
+#define desbloquear(t) trincoDesbloquear((t), NULL)
 void* Thread(void* args); // thread principal
 void tratamento_interrupcao();
+void fixar_cliente(pthread_attr_t *attr, int i);
 
-int main() {
+// Uso: main [--semente N] [--virtual]
+// kill -USR1 imprime o perfil de contenção do trinco da região crítica.
+int main(int argc, char *argv[]) {
 	pthread_t threads[INICIAL];
 	int i;
-
-	srand(time(NULL));
+	uint64_t semente = (uint64_t)time(NULL);
+	Aleatorio base;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--semente") == 0 && i + 1 < argc)
+			semente = strtoull(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "--virtual") == 0)
+			relogio_virtual = 1;
+	}
+	printf("Semente: %llu\n", (unsigned long long)semente);
+	semearAleatorio(&base, semente);
+	for (i = 0; i < INICIAL; i++) {
+		fluxos[i] = base;
+		saltarAleatorio(&base);
+	}
 
 	// Alocação dinâmica de memória para o buffer
 	regicao_critica = (buffer*)malloc(INICIAL * sizeof(buffer));
@@ -44,13 +84,16 @@ int main() {
 		return 1;
 	}
 
-	pthread_mutex_init(&mutex, NULL);
+	signal(SIGUSR1, trincoPedirPerfil);
 	sem_init(&sem_reserva, 0, 5);  // Limite de 5 threads de reserva ao mesmo tempo
 	sem_init(&sem_consulta, 0, 5); // Limite de 5 threads de consulta ao mesmo tempo
 
 	for (i = 0; i < 10; i++) {
 		intptr_t buffer_index = i;
-		pthread_create(&threads[i], NULL, Thread, (void*)buffer_index);
+		pthread_attr_t attr;
+		fixar_cliente(&attr, i);
+		pthread_create(&threads[i], &attr, Thread, (void*)buffer_index);
+		pthread_attr_destroy(&attr);
 	}
 
 	for (i = 0; i < INICIAL; i++)
@@ -58,10 +101,10 @@ int main() {
 
 	// Liberação da memória alocada dinamicamente
 	free(regicao_critica);
-	pthread_mutex_destroy(&mutex);
 	sem_destroy(&sem_reserva);
 	sem_destroy(&sem_consulta);
 
+	imprimir_perfil();
 	printf("Finalizado.\n");
 	return 0;
 }
@@ -73,12 +116,12 @@ void* reserva(void* args) {
 	int buf_index = (intptr_t)args;
 	int pnr = (unsigned int)pthread_self();
 
-	pthread_mutex_lock(&mutex);
+	bloquear(&mutex);
 	regicao_critica[buf_index].pnr = pnr;
 	regicao_critica[buf_index].reserva = 1;
 	regicao_critica[buf_index].consulta = 0;
 	regicao_critica[buf_index].cancelamento = 0;
-	pthread_mutex_unlock(&mutex);
+	desbloquear(&mutex);
 
 	printf("[Reserva] PNR da thread: %d\n", pnr);
 	ver_dados();
@@ -94,12 +137,12 @@ void* consulta(void* args) {
 	int buf_index = (intptr_t)args;
 	int pnr = (unsigned int)pthread_self();
 
-	pthread_mutex_lock(&mutex);
+	bloquear(&mutex);
 	regicao_critica[buf_index].pnr = pnr;
 	regicao_critica[buf_index].reserva = 0;
 	regicao_critica[buf_index].consulta = 1;
 	regicao_critica[buf_index].cancelamento = 0;
-	pthread_mutex_unlock(&mutex);
+	desbloquear(&mutex);
 
 	printf("[Consulta] PNR da thread: %d\n", pnr);
 	ver_dados();
@@ -115,12 +158,12 @@ void* cancelamento(void* args) {
 	int buf_index = (intptr_t)args;
 	int pnr = (unsigned int)pthread_self();
 
-	pthread_mutex_lock(&mutex);
+	bloquear(&mutex);
 	regicao_critica[buf_index].pnr = pnr;
 	regicao_critica[buf_index].reserva = 0;
 	regicao_critica[buf_index].consulta = 0;
 	regicao_critica[buf_index].cancelamento = 1;
-	pthread_mutex_unlock(&mutex);
+	desbloquear(&mutex);
 
 	printf("[Cancelamento] PNR da thread: %d\n", pnr);
 	ver_dados();
@@ -131,13 +174,17 @@ void* cancelamento(void* args) {
 
 void ver_dados() {
 	int i; 
-	pthread_mutex_lock(&mutex);
+	bloquear(&mutex);
 	printf("\n=== Processos/Threads em execução ===\n");
 
 	for (i = 0; i < INICIAL; i++)
 		printf("PNR: %d | Reserva: %d | Consulta: %d | Cancelamento: %d\n", regicao_critica[i].pnr, regicao_critica[i].reserva, regicao_critica[i].consulta, regicao_critica[i].cancelamento);
 	
-	pthread_mutex_unlock(&mutex);
+	desbloquear(&mutex);
+	if (relogio_virtual)
+		printf("Pausas simuladas até agora: %ld s\n", atomic_load(&segundos_virtuais));
+	if (trincoPerfilPedido())
+		imprimir_perfil();
 }
 
 void* Thread(void* args) {
@@ -145,7 +192,7 @@ void* Thread(void* args) {
 	int i; 
 	
 	while (TRUE) {
-		int f = rand() % 3;
+		int f = aleatorioEm(&fluxos[index], 3);
 		pthread_t thread;
 
 		if (f == 0)
@@ -161,7 +208,35 @@ void* Thread(void* args) {
 	return NULL;
 }
 
+void imprimir_perfil() {
+	printf("\n=== Perfil do trinco ===\n");
+	imprimirPerfilTrinco("região crítica", &mutex);
+}
+
 // Função para simular a interrupção durante o processo
 void tratamento_interrupcao() {
-  sleep(1);  // Simula uma "interrupção" do processo, com uma pausa de 1 segundo
+  if (relogio_virtual)
+    atomic_fetch_add(&segundos_virtuais, 1);
+  else
+    sleep(1);  // Simula uma "interrupção" do processo, com uma pausa de 1 segundo
+}
+
+// Fixa o cliente i a um CPU (distribuidos em roda pelos CPUs permitidos ao
+// processo), para que nao salte entre cores. As threads de operacao que o
+// cliente cria herdam a mesma afinidade.
+void fixar_cliente(pthread_attr_t *attr, int i) {
+	cpu_set_t permitidos, escolhido;
+	int n, cpu;
+
+	pthread_attr_init(attr);
+	if (sched_getaffinity(0, sizeof(permitidos), &permitidos) != 0)
+		return;
+	n = i % CPU_COUNT(&permitidos);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &permitidos) && n-- == 0)
+			break;
+	}
+	CPU_ZERO(&escolhido);
+	CPU_SET(cpu, &escolhido);
+	pthread_attr_setaffinity_np(attr, sizeof(escolhido), &escolhido);
 }
@@ -5,8 +5,8 @@
 #include <semaphore.h>
 #include <time.h>
 #include <stdint.h>
-#include <sys/select.h> // Inclui para usar select()
-#include <stdbool.h>
+
+#include "controlo.h"
 
 #define INICIAL 10 // n de Threads/"clientes"
 #define TRUE 1
@@ -31,7 +31,6 @@ void* cancelamento(void* args);
 void ver_dados();
 void* Thread(void* args); // thread principal
 void tratamento_interrupcao();
-void verificar_interrupcao();
 
 int main() {
 	pthread_t threads[INICIAL];
@@ -51,6 +50,9 @@ int main() {
 	sem_init(&sem_reserva, 0, 5);  // Limite de 5 threads de reserva ao mesmo tempo
 	sem_init(&sem_consulta, 0, 5); // Limite de 5 threads de consulta ao mesmo tempo
 
+	if (iniciar_controlo("main1") != 0)
+		return 1;
+
 	for (i = 0; i < 10; i++) {
 		intptr_t buffer_index = i;
 		pthread_create(&threads[i], NULL, Thread, (void*)buffer_index);
@@ -59,6 +61,9 @@ int main() {
 	for (i = 0; i < INICIAL; i++)
 		pthread_join(threads[i], NULL);
 
+	// Todos os clientes terminaram: pede a thread de controlo para sair
+	terminar_controlo();
+
 	// Liberacao da memoria alocada dinamicamente
 	free(regicao_critica);
 	pthread_mutex_destroy(&mutex);
@@ -72,6 +77,10 @@ int main() {
 void* reserva(void* args) {
 	sem_wait(&sem_reserva);
 	tratamento_interrupcao();  // Simula interrupcao durante a operacao
+	if (atomic_load(&estado_global) == ENCERRAR) { // encerramento: nao escreve mais nada
+		sem_post(&sem_reserva);
+		return NULL;
+	}
 
 	int buf_index = (intptr_t)args;
 	int pnr = (unsigned int)pthread_self();
@@ -93,6 +102,10 @@ void* reserva(void* args) {
 void* consulta(void* args) {
 	sem_wait(&sem_consulta);
 	tratamento_interrupcao();  // Simula interrupcao durante a operacao
+	if (atomic_load(&estado_global) == ENCERRAR) { // encerramento: nao escreve mais nada
+		sem_post(&sem_consulta);
+		return NULL;
+	}
 
 	int buf_index = (intptr_t)args;
 	int pnr = (unsigned int)pthread_self();
@@ -114,6 +127,10 @@ void* consulta(void* args) {
 void* cancelamento(void* args) {
 	sem_wait(&sem_consulta);
 	tratamento_interrupcao();  // Simula interrupcao durante a operacao
+	if (atomic_load(&estado_global) == ENCERRAR) { // encerramento: nao escreve mais nada
+		sem_post(&sem_consulta);
+		return NULL;
+	}
 
 	int buf_index = (intptr_t)args;
 	int pnr = (unsigned int)pthread_self();
@@ -147,8 +164,7 @@ void* Thread(void* args) {
 	int index = (intptr_t)args;
 	int i; 
 	
-	while (true) {
-		verificar_interrupcao();
+	while (verificar_interrupcao()) {
 		int f = rand() % 3;
 		pthread_t thread;
 		if (f == 0)
@@ -168,33 +184,3 @@ void* Thread(void* args) {
 void tratamento_interrupcao() {
   sleep(1);  // Simula uma "interrupcao" do processo, com uma pausa de 1 segundo
 }
-
-// Verifica se a barra de espao foi pressionada (com select())
-void verificar_interrupcao() {
-    char c;
-    bool pausa_global;
-    
-    
-    fd_set rfds;
-    struct timeval tv;
-
-    FD_ZERO(&rfds);
-    FD_SET(STDIN_FILENO, &rfds);
-
-    tv.tv_sec = 0; // Verifica imediatamente (sem timeout)
-    tv.tv_usec = 0;
-
-    int retval = select(1, &rfds, NULL, NULL, &tv);
-
-    if (retval == -1) {
-        perror("select()");
-        exit(1);
-    } else if (retval) {
-        if (read(STDIN_FILENO, &c, 1) > 0 && c == ' ') {
-            printf("\n[Interrupcao] Barra de espao pressionada. Pausando por 5 segundos...\n");
-            pausa_global = true; // Ativa a flag de pausa
-            sleep(5);
-            pausa_global = false; // Desativa a flag de pausa
-        }
-    }
-}
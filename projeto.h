@@ -0,0 +1,226 @@
+// Motor de reservas: o armazenamento das reservas (PNRNode, ArmazemPNR) e o
+// que os módulos do programa usam do motor (Projeto.c). Cada módulo tem o seu
+// .h: índice por prazo (indice.h), executor (executor.h), fluxo de eventos
+// (cdc.h), pedidos idempotentes (dedup.h) e servidor de pedidos (servidor.h).
+// Compilar com o programa: make (ver Makefile)
+#ifndef PROJETO_H
+#define PROJETO_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "trinco.h"
+#include "aleatorio.h"
+
+// Estrutura para armazenar cada reserva (PNR), compactada em 12 bytes. Os nós
+// vivem num bloco contíguo (ArmazemPNR) e referem-se por índices em vez de
+// ponteiros, para que o mesmo bloco possa estar em memória partilhada e ser
+// usado por vários processos. Um milhão de reservas ocupa assim 24 MB
+// (nós, vetor denso e tabela de PNRs) em vez de 28 MB só com os nós antigos.
+typedef struct PNRNode {
+    uint32_t pnr;             // até 6 caracteres [0-9A-Z] cabem em 32 bits (codificarPNR)
+    uint32_t estado;          // prazo em segundos desde EPOCA_RESERVAS << 1 | pago
+    int32_t ligacao;          // nó vivo: posição em densos[]; nó livre: LIGACAO_LIVRE(próximo livre)
+} PNRNode;
+
+#define NENHUM (-1)             // fim de lista
+#define PRAZO_PAGAMENTO 60      // segundos até uma reserva não paga expirar
+#define CAPACIDADE_PNR 65536    // reservas em simultâneo em cada partição
+#define MAGIA_ARMAZEM 0x54414134 // "TAA4": bloco partilhado já inicializado (registos compactos, nome do CDC, tabela de PNRs)
+#define MAX_NOME_CDC 64         // nome do segmento CDC registado nas partições --shm
+#define EPOCA_RESERVAS 1704067200 // 2024-01-01 00:00 UTC; 31 bits de segundos chegam a 2092
+
+// Nó livre: a ligação guarda o próximo livre como -2 - próximo, que é sempre
+// negativo (NENHUM passa a NENHUM). A mesma conversão serve nos dois sentidos.
+#define LIGACAO_LIVRE(proximo) (-2 - (proximo))
+#define PROXIMO_LIVRE(ligacao) (-2 - (ligacao))
+
+_Static_assert(sizeof(PNRNode) == 12, "PNRNode deve ocupar 12 bytes");
+
+static inline uint32_t empacotarEstado(time_t timestamp, int pago) {
+    return (uint32_t)(timestamp + PRAZO_PAGAMENTO - EPOCA_RESERVAS) << 1 | (pago != 0);
+}
+
+// Prazo de pagamento da reserva (instante da reserva + PRAZO_PAGAMENTO)
+static inline time_t prazoDe(const PNRNode *n) {
+    return (time_t)EPOCA_RESERVAS + (n->estado >> 1);
+}
+
+static inline time_t momentoDe(const PNRNode *n) {
+    return prazoDe(n) - PRAZO_PAGAMENTO;
+}
+
+static inline int pagoDe(const PNRNode *n) {
+    return n->estado & 1;
+}
+
+#define PNR_INVALIDO UINT32_MAX
+#define DIGITOS_PNR 6
+#define LIMITE_PNR 2176782336u // 36^6: os códigos de PNR vão de 0 a LIMITE_PNR - 1
+
+// Converte um PNR de até 6 caracteres [0-9A-Za-z] no seu código de 32 bits
+// (base 36). Retorna PNR_INVALIDO se o texto não for um PNR.
+uint32_t codificarPNR(const char *texto);
+
+// Escreve em texto (pelo menos 7 bytes) os 6 caracteres do PNR com o código dado
+void descodificarPNR(uint32_t codigo, char *texto);
+
+// Texto de um PNR para as mensagens, usável diretamente num printf:
+// printf("%s", textoPNR(pnr).texto). "?" se o código não for de um PNR.
+typedef struct {
+    char texto[DIGITOS_PNR + 1];
+} TextoPNR;
+
+static inline TextoPNR textoPNR(uint32_t codigo) {
+    TextoPNR t = { "?" };
+    if (codigo < LIMITE_PNR)
+        descodificarPNR(codigo, t.texto);
+    return t;
+}
+
+// Cada partição tem o seu bloco e o seu mutex; um PNR pertence sempre à
+// partição pnr % n_particoes. As reservas vivas estão também num vetor denso
+// (densos[0..n_reservas-1], a seguir aos nós): remover troca com a última, e
+// escolher uma reserva ao acaso é só sortear uma posição. Depois do vetor
+// denso vem a tabela PNR -> nó (endereçamento aberto, sondagem linear, com o
+// dobro das posições da capacidade), para que procurar um PNR seja O(1) com a
+// partição bloqueada.
+typedef struct {
+    pthread_mutex_t mutex;    // protege tudo o que se segue no modo --shm (robusto e partilhado); em memória local usa-se o trinco da partição
+    atomic_uint magia;
+    int32_t livre;            // primeiro nó livre
+    int32_t capacidade;
+    atomic_int n_reservas;    // lido sem bloqueio para escolher a partição
+    char cdc[MAX_NOME_CDC];   // segmento CDC onde publicam todos os processos do --shm ("" sem CDC)
+    PNRNode nos[];            // seguido de int32_t densos[capacidade] e int32_t tabela[POSICOES_TABELA_PNR]
+} ArmazemPNR;
+
+#define MAX_PARTICOES 64
+#define PARTICOES_POR_OMISSAO 4
+
+extern ArmazemPNR *meuPNR[MAX_PARTICOES];
+extern int n_particoes;
+extern const char *nome_shm;    // --shm
+extern const char *nome_cdc;    // --cdc ou, com --shm, o do segmento
+
+#define NO(a, i) (&(a)->nos[i])
+#define DENSOS(a) ((int32_t*)&(a)->nos[(a)->capacidade])
+
+// Eventos que alteram o armazenamento de reservas (replicados para a réplica
+// e publicados no segmento CDC)
+enum { EVENTO_RESERVA = 1, EVENTO_PAGAMENTO, EVENTO_CANCELAMENTO, EVENTO_EXPIRACAO, EVENTO_SNAPSHOT };
+
+typedef struct {
+    uint64_t seq;        // número de sequência atribuído pelo primário
+    int64_t instante_ms; // quando o evento aconteceu no primário (para medir o atraso)
+    int64_t timestamp;   // horário da reserva
+    uint32_t pnr;
+    int16_t tipo;
+    int16_t pago;
+} EventoReplicacao;
+
+// Emite o evento para a réplica e para o CDC, com a partição do PNR bloqueada
+void emitirEvento(int tipo, uint32_t pnr, time_t timestamp, int pago);
+
+// Os mesmos códigos do protocolo do servidor; OP_EXPIRAR só aparece no registo
+enum { OP_RESERVAR = 1, OP_CONSULTAR, OP_PAGAR, OP_CANCELAR, OP_EXPIRAR };
+extern const char *NOMES_OPS[];
+
+enum { RESULTADO_OK = 0, RESULTADO_VAZIO, RESULTADO_TODOS_PAGOS, RESULTADO_CHEIO,
+       RESULTADO_INEXISTENTE, RESULTADO_JA_PAGO, RESULTADO_RECUSADO, RESULTADO_INVALIDO,
+       RESULTADO_EM_ESPERA };   // reserva na lista de espera do voo (só na tabela de pedidos)
+
+typedef struct {
+    int codigo;
+    uint32_t pnr;
+} Resultado;
+
+// Argumento das threads de operação
+typedef struct {
+    uint64_t id;              // ID do pedido do cliente (0 = sem ID)
+    int particao;
+    uint32_t pnr;             // PNR consultado (PNR_INVALIDO = um ao acaso da partição)
+} Pedido;
+
+int particaoDoPNR(uint32_t pnr);
+
+// Atributos de criação de thread fixados a cpus (sem fixação se estiver
+// vazio) ou, em atributosOperacao, aos CPUs das operações sobre a partição p
+void atributosFixados(pthread_attr_t *attr, const cpu_set_t *cpus);
+void atributosOperacao(pthread_attr_t *attr, int p);
+
+// Bloqueia a partição p e devolve-a, registando no perfil o sítio da chamada
+ArmazemPNR* bloquearPNREm(int p, const char *funcao, int linha);
+#define bloquearPNR(p) bloquearPNREm((p), __func__, __LINE__)
+void desbloquearPNR(int p);
+
+// Gerador aleatório da thread atual e inteiro uniforme em [0, n) dele
+Aleatorio* geradorThread(void);
+uint32_t aleatorio(uint32_t n);
+
+// Relógio do motor (virtual com --simular); agoraNs e agoraMs são reais
+int64_t relogioAgoraMs(void);
+time_t relogioAgora(void);
+int64_t agoraNs(void);
+int64_t agoraMs(void);
+
+// Futexes que servem entre processos
+void futexEsperar(atomic_uint *p, unsigned valor, long ms);
+void futexAcordar(atomic_uint *p, int n);
+
+// 0 a partir da drenagem; pedirDrenagem é o tratador de SIGINT/SIGTERM
+int motorAtivo(void);
+void pedirDrenagem(int sinal);
+
+// Ligações por socket Unix ou "tcp:PORTA" (ver abrirLigacao)
+int abrirLigacao(const char *destino, int servidor);
+int escreverTudo(int fd, const void *buf, size_t n);
+int lerTudo(int fd, void *buf, size_t n);
+
+// Arranque do motor, pelo main e pelos testes: geradores, trincos das
+// partições, armazenamento (com o índice) e cache de consultas
+void semearGeradores(uint64_t semente);
+void iniciarTrincos(void);
+int abrirArmazem(void);
+void fecharArmazem(void);
+void abrirCacheConsultas(void);
+
+// Listas de espera dos voos (--lugares N): esperarLugar põe na lista do voo p
+// o cliente da reserva id, recusada por falta de lugar (o pedido conclui-se
+// com o lugar), entregarLugares dá os lugares libertados aos mais antigos e
+// encerrarListasEspera despede todos
+extern int lugares_por_voo;
+void esperarLugar(int p, uint64_t id);
+void entregarLugares(int p);
+void encerrarListasEspera(void);
+int clientesEmEspera(int p);
+
+// Executa um pedido de um cliente externo ou da reprodução de um registo;
+// nas consultas devolve também o prazo em *prazo_consulta
+Resultado executarPedido(int op, uint64_t id, uint32_t pnr, time_t *prazo_consulta);
+
+#endif
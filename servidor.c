@@ -0,0 +1,429 @@
+#include "projeto.h"
+#include "executor.h"
+#include "servidor.h"
+
+#define MAX_CLIENTES_REDE 64
+#define BUFFER_REDE 65536
+#define CORPO_PEDIDO 13
+#define CORPO_RESPOSTA 22
+// Pedidos em curso por cliente: cada um tem lugar reservado na saída
+#define PEDIDOS_POR_CLIENTE (BUFFER_REDE / (4 + CORPO_RESPOSTA))
+
+struct ClienteRede;
+
+// Um pedido entregue ao executor; a resposta volta pela pilha respostas_rede
+typedef struct PedidoRede {
+    struct ClienteRede *cliente; // só a thread do servidor lhe mexe
+    unsigned char corpo[CORPO_PEDIDO];
+    unsigned char resposta[4 + CORPO_RESPOSTA];
+    struct PedidoRede *prox;  // na pilha de respostas ou nos livres do cliente
+} PedidoRede;
+
+// Os pedidos de um cliente vêm dos seus próprios registos (alocados com ele e
+// só tocados pela thread do servidor), por isso nenhum pedido aloca memória
+typedef struct ClienteRede {
+    int fd;
+    int fechado;              // ligação fechada, à espera dos pedidos em curso
+    int em_curso;             // pedidos no executor (cada um tem lugar reservado na saída)
+    int por_enviar;           // tem respostas novas na saída (escreverRespostas)
+    size_t n_entrada, n_saida, enviado;
+    unsigned char entrada[BUFFER_REDE];
+    unsigned char saida[BUFFER_REDE];
+    PedidoRede *livres;
+    PedidoRede pedidos[PEDIDOS_POR_CLIENTE];
+} ClienteRede;
+
+const char *enderecos_servidor[MAX_ESCUTAS];
+int n_enderecos_servidor = 0;
+atomic_int parar_servidor = 0;
+static atomic_long pedidos_rede = 0, leituras_rede = 0, escritas_rede = 0;
+static _Atomic(PedidoRede*) respostas_rede = NULL; // pedidos executados, à espera de ser escritos
+static int acordar_servidor[2] = { -1, -1 }; // pipe: chegou a primeira resposta à pilha vazia
+static int pedidos_rede_em_curso = 0;       // da thread do servidor
+
+static void escrever32(unsigned char *b, uint32_t v) {
+    v = htonl(v);
+    memcpy(b, &v, 4);
+}
+
+static void escrever64(unsigned char *b, uint64_t v) {
+    escrever32(b, v >> 32);
+    escrever32(b + 4, (uint32_t)v);
+}
+
+static uint32_t ler32(const unsigned char *b) {
+    uint32_t v;
+    memcpy(&v, b, 4);
+    return ntohl(v);
+}
+
+static uint64_t ler64(const unsigned char *b) {
+    return (uint64_t)ler32(b) << 32 | ler32(b + 4);
+}
+
+
+// Executa um pedido da rede e escreve a resposta (CORPO_RESPOSTA + 4 bytes) em r
+static void executarPedidoRede(const unsigned char *corpo, unsigned char *r) {
+    int op = corpo[0];
+    uint64_t id = ler64(corpo + 1);
+    time_t prazo;
+    Resultado res = executarPedido(op, id, ler32(corpo + 9), &prazo);
+    atomic_fetch_add_explicit(&pedidos_rede, 1, memory_order_relaxed);
+
+    escrever32(r, CORPO_RESPOSTA);
+    r[4] = op;
+    r[5] = res.codigo;
+    escrever64(r + 6, id);
+    escrever32(r + 14, res.pnr);
+    escrever64(r + 18, (uint64_t)prazo);
+}
+
+// Tarefa do executor: executa o pedido e devolve-o à thread do servidor,
+// que só é acordada quando a pilha estava vazia
+static void* tarefaPedidoRede(void* arg) {
+    PedidoRede *pr = arg;
+    executarPedidoRede(pr->corpo, pr->resposta);
+    PedidoRede *topo = atomic_load(&respostas_rede);
+    do {
+        pr->prox = topo;
+    } while (!atomic_compare_exchange_weak(&respostas_rede, &topo, pr));
+    if (!topo) {
+        ssize_t escrito = write(acordar_servidor[1], "r", 1);
+        (void)escrito; // pipe cheio: a thread já tem o que ler
+    }
+    return NULL;
+}
+
+// Entrega ao executor os pedidos completos que estão no buffer de entrada,
+// enquanto houver lugar na saída para as respostas de todos os que estão em
+// curso. Retorna -1 se o cliente violou o protocolo.
+static int tratarEntrada(ClienteRede *c) {
+    size_t k = 0;
+    while (c->n_entrada - k >= 4 &&
+           BUFFER_REDE - c->n_saida >= (size_t)(c->em_curso + 1) * (4 + CORPO_RESPOSTA)) {
+        uint32_t comprimento = ler32(c->entrada + k);
+        if (comprimento != CORPO_PEDIDO)
+            return -1;
+        if (c->n_entrada - k < 4 + comprimento)
+            break;
+        PedidoRede *pr = c->livres;
+        if (!pr)
+            break; // fica no buffer até voltar uma resposta
+        c->livres = pr->prox;
+        pr->cliente = c;
+        memcpy(pr->corpo, c->entrada + k + 4, CORPO_PEDIDO);
+        uint32_t pnr = ler32(pr->corpo + 9);
+        int p = pnr != 0 ? particaoDoPNR(pnr) : (int)aleatorio(n_particoes);
+        if (executorSubmeter(executor, trabalhadorDaParticao(p), tarefaPedidoRede, pr) != 0)
+            tarefaPedidoRede(pr); // sem executor: executa-o aqui
+        c->em_curso++;
+        pedidos_rede_em_curso++;
+        k += 4 + comprimento;
+    }
+    memmove(c->entrada, c->entrada + k, c->n_entrada - k);
+    c->n_entrada -= k;
+    return 0;
+}
+
+// Envia o que houver no buffer de saída. Retorna -1 se a ligação caiu.
+static int enviarSaida(ClienteRede *c) {
+    if (c->enviado == c->n_saida)
+        return 0;
+    ssize_t n = send(c->fd, c->saida + c->enviado, c->n_saida - c->enviado, MSG_NOSIGNAL);
+    if (n == -1)
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    atomic_fetch_add_explicit(&escritas_rede, 1, memory_order_relaxed);
+    c->enviado += n;
+    if (c->enviado == c->n_saida)
+        c->enviado = c->n_saida = 0;
+    return 0;
+}
+
+// Escreve nas saídas dos clientes as respostas que os trabalhadores
+// devolveram (pela ordem em que acabaram) e depois tenta uma só escrita por
+// cliente com as respostas todas; o resto vai com o POLLOUT. Os clientes já
+// fechados libertam-se com a última resposta.
+static void escreverRespostas(void) {
+    ClienteRede *tocados[MAX_CLIENTES_REDE];
+    int n_tocados = 0;
+    char lixo[64];
+    while (read(acordar_servidor[0], lixo, sizeof(lixo)) > 0)
+        ;
+    PedidoRede *pr = atomic_exchange(&respostas_rede, NULL), *ordem = NULL;
+    while (pr) { // a pilha tem a mais recente primeiro
+        PedidoRede *prox = pr->prox;
+        pr->prox = ordem;
+        ordem = pr;
+        pr = prox;
+    }
+    while (ordem) {
+        PedidoRede *prox = ordem->prox;
+        ClienteRede *c = ordem->cliente;
+        c->em_curso--;
+        pedidos_rede_em_curso--;
+        ordem->prox = c->livres;
+        c->livres = ordem;
+        if (!c->fechado) {
+            memcpy(c->saida + c->n_saida, ordem->resposta, 4 + CORPO_RESPOSTA);
+            c->n_saida += 4 + CORPO_RESPOSTA;
+            if (!c->por_enviar) {
+                c->por_enviar = 1;
+                tocados[n_tocados++] = c;
+            }
+        } else if (c->em_curso == 0) {
+            free(c);
+        }
+        ordem = prox;
+    }
+    for (int k = 0; k < n_tocados; k++) {
+        tocados[k]->por_enviar = 0;
+        enviarSaida(tocados[k]); // um erro vê-se na próxima volta do poll()
+    }
+}
+
+// Fecha a ligação; o cliente só se liberta quando não tiver pedidos em curso
+static void fecharCliente(ClienteRede *c) {
+    close(c->fd);
+    c->fechado = 1;
+    if (c->em_curso == 0)
+        free(c);
+}
+
+void* servidor_thread(void* arg) {
+    int escutas[MAX_ESCUTAS];
+    ClienteRede *clientes[MAX_CLIENTES_REDE];
+    int n_clientes = 0;
+    struct pollfd fds[1 + MAX_ESCUTAS + MAX_CLIENTES_REDE];
+
+    if (pipe(acordar_servidor) == -1) {
+        perror("Erro ao criar o pipe do servidor");
+        return NULL;
+    }
+    fcntl(acordar_servidor[0], F_SETFL, O_NONBLOCK);
+    fcntl(acordar_servidor[1], F_SETFL, O_NONBLOCK);
+    for (int e = 0; e < n_enderecos_servidor; e++) {
+        escutas[e] = abrirLigacao(enderecos_servidor[e], 1);
+        if (escutas[e] == -1)
+            fprintf(stderr, "Erro ao abrir o servidor em %s: %s\n", enderecos_servidor[e], strerror(errno));
+        else
+            printf("[Servidor] À escuta em %s.\n", enderecos_servidor[e]);
+    }
+
+    // fds: as escutas, os clientes e, no fim, o pipe das respostas
+    while (!atomic_load(&parar_servidor)) {
+        for (int e = 0; e < n_enderecos_servidor; e++)
+            fds[e] = (struct pollfd){ .fd = escutas[e], .events = POLLIN };
+        for (int k = 0; k < n_clientes; k++) {
+            ClienteRede *c = clientes[k];
+            short eventos = 0;
+            if (c->n_entrada < BUFFER_REDE)
+                eventos |= POLLIN;
+            if (c->n_saida > c->enviado)
+                eventos |= POLLOUT;
+            fds[n_enderecos_servidor + k] = (struct pollfd){ .fd = c->fd, .events = eventos };
+        }
+        int n_fds = n_enderecos_servidor + n_clientes;
+        fds[n_fds] = (struct pollfd){ .fd = acordar_servidor[0], .events = POLLIN };
+        if (poll(fds, n_fds + 1, 100) <= 0)
+            continue; // também para ver parar_servidor
+        if (fds[n_fds].revents & POLLIN)
+            escreverRespostas();
+
+        for (int e = 0; e < n_enderecos_servidor; e++) {
+            if (!(fds[e].revents & POLLIN))
+                continue;
+            int fd = accept(escutas[e], NULL, NULL);
+            if (fd == -1)
+                continue;
+            if (n_clientes == MAX_CLIENTES_REDE) {
+                close(fd);
+                continue;
+            }
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            int um = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &um, sizeof(um)); // falha (e não faz mal) em sockets Unix
+            ClienteRede *c = malloc(sizeof(ClienteRede));
+            if (!c) {
+                perror("Erro ao alocar memória");
+                close(fd);
+                continue;
+            }
+            c->fd = fd;
+            c->fechado = c->em_curso = c->por_enviar = 0;
+            c->n_entrada = c->n_saida = c->enviado = 0;
+            c->livres = NULL;
+            for (int j = PEDIDOS_POR_CLIENTE - 1; j >= 0; j--) {
+                c->pedidos[j].prox = c->livres;
+                c->livres = &c->pedidos[j];
+            }
+            clientes[n_clientes++] = c;
+        }
+
+        // Os clientes aceites agora não estão em fds e só entram na próxima volta
+        int n_vistos = n_clientes;
+        for (int k = 0; k < n_vistos && k < n_clientes; k++) {
+            ClienteRede *c = clientes[k];
+            short revents = fds[n_enderecos_servidor + k].revents;
+            int fechar = (revents & (POLLERR | POLLNVAL)) != 0;
+            if (!fechar && (revents & (POLLIN | POLLHUP))) {
+                ssize_t n = recv(c->fd, c->entrada + c->n_entrada, BUFFER_REDE - c->n_entrada, 0);
+                if (n > 0) {
+                    atomic_fetch_add_explicit(&leituras_rede, 1, memory_order_relaxed);
+                    c->n_entrada += n;
+                } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                    fechar = 1;
+                }
+            }
+            // Trata o que chegou, envia, e volta a tratar se a saída bloqueava a entrada
+            while (!fechar) {
+                size_t antes = c->n_entrada;
+                if (tratarEntrada(c) == -1 || enviarSaida(c) == -1)
+                    fechar = 1;
+                if (c->n_entrada == antes || c->n_saida > 0)
+                    break;
+            }
+            if (fechar) {
+                fecharCliente(c);
+                clientes[k] = clientes[--n_clientes];
+                fds[n_enderecos_servidor + k] = fds[n_enderecos_servidor + n_clientes];
+                k--;
+                n_vistos--;
+            }
+        }
+    }
+
+    // Espera pelas respostas dos pedidos que ainda estão no executor
+    for (int k = 0; k < n_clientes; k++)
+        fecharCliente(clientes[k]);
+    while (pedidos_rede_em_curso > 0) {
+        struct pollfd pipe_fd = { .fd = acordar_servidor[0], .events = POLLIN };
+        poll(&pipe_fd, 1, 100);
+        escreverRespostas();
+    }
+    close(acordar_servidor[0]);
+    close(acordar_servidor[1]);
+    for (int e = 0; e < n_enderecos_servidor; e++) {
+        if (escutas[e] == -1)
+            continue;
+        close(escutas[e]);
+        if (strncmp(enderecos_servidor[e], "tcp:", 4) != 0)
+            unlink(enderecos_servidor[e]);
+    }
+    return NULL;
+}
+
+void imprimirMetricasServidor(void) {
+    if (n_enderecos_servidor == 0)
+        return;
+    long pedidos = atomic_load(&pedidos_rede), leituras = atomic_load(&leituras_rede), escritas = atomic_load(&escritas_rede);
+    printf("Servidor: %ld pedido(s) em %ld leitura(s) e %ld escrita(s) (%.1f pedidos por escrita)\n",
+           pedidos, leituras, escritas, escritas ? (double)pedidos / escritas : 0.0);
+}
+
+// --carga ENDERECO N: cliente gerador de carga. Envia lotes de JANELA_CARGA
+// reservas de uma vez e, com os PNRs devolvidos, lotes de consultas,
+// pagamentos e cancelamentos, até N pedidos; mede pedidos por segundo.
+#define JANELA_CARGA 64
+
+static int receberRespostas(int fd, int n, uint32_t *pnrs) {
+    unsigned char r[4 + CORPO_RESPOSTA];
+    int ok = 0;
+    for (int k = 0; k < n; k++) {
+        if (lerTudo(fd, r, sizeof(r)) == -1 || ler32(r) != CORPO_RESPOSTA)
+            return -1;
+        if (r[5] == RESULTADO_OK)
+            ok++;
+        if (pnrs)
+            pnrs[k] = r[5] == RESULTADO_OK ? ler32(r + 4 + 10) : PNR_INVALIDO;
+    }
+    return ok;
+}
+
+static int enviarLote(int fd, int op, uint64_t *id, const uint32_t *pnrs, int n) {
+    unsigned char lote[JANELA_CARGA * (4 + CORPO_PEDIDO)], *b = lote;
+    for (int k = 0; k < n; k++, b += 4 + CORPO_PEDIDO) {
+        escrever32(b, CORPO_PEDIDO);
+        b[4] = op;
+        escrever64(b + 5, (*id)++);
+        escrever32(b + 13, pnrs ? pnrs[k] : 0);
+    }
+    return escreverTudo(fd, lote, b - lote);
+}
+
+int gerarCarga(const char *endereco, long total) {
+    int fd = abrirLigacao(endereco, 0);
+    if (fd == -1) {
+        perror("Erro ao ligar ao servidor");
+        return 1;
+    }
+    uint64_t id = ((uint64_t)getpid() << 32) | 1; // IDs distintos entre clientes
+    uint32_t pnrs[JANELA_CARGA];
+    long enviados = 0, sucessos = 0;
+    int64_t inicio = agoraNs();
+    while (enviados < total) {
+        static const int OPS[] = { OP_CONSULTAR, OP_PAGAR, OP_CANCELAR };
+        if (enviarLote(fd, OP_RESERVAR, &id, NULL, JANELA_CARGA) == -1)
+            break;
+        int ok = receberRespostas(fd, JANELA_CARGA, pnrs);
+        if (ok == -1)
+            break;
+        sucessos += ok;
+        enviados += JANELA_CARGA;
+        for (int o = 0; o < 3 && enviados < total; o++) {
+            if (enviarLote(fd, OPS[o], &id, pnrs, JANELA_CARGA) == -1 || (ok = receberRespostas(fd, JANELA_CARGA, NULL)) == -1)
+                goto fim;
+            sucessos += ok;
+            enviados += JANELA_CARGA;
+        }
+    }
+fim:
+    close(fd);
+    double segundos = (agoraNs() - inicio) / 1e9;
+    printf("Carga: %ld pedido(s) (%ld com sucesso) em %.2f s: %.0f pedidos/s\n",
+           enviados, sucessos, segundos, enviados / segundos);
+    return 0;
+}
+
+// --pedir DESTINO OP PNR: envia um só pedido ao servidor e mostra a resposta.
+// OP é reserva, consulta, pagamento ou cancelamento; o PNR vai em texto (até
+// 6 caracteres [0-9A-Z]), ou "-" numa reserva para o servidor escolher um novo.
+int enviarPedido(const char *endereco, const char *nome_op, const char *texto_pnr) {
+    static const char *NOMES_RESULTADOS[] = { "ok", "vazio", "todos pagos", "cheio",
+                                              "inexistente", "já pago", "recusado", "inválido", "em espera" };
+    int op = OP_RESERVAR;
+    while (op <= OP_CANCELAR && strcmp(nome_op, NOMES_OPS[op]) != 0)
+        op++;
+    uint32_t pnr = op == OP_RESERVAR && strcmp(texto_pnr, "-") == 0 ? 0 : codificarPNR(texto_pnr);
+    if (op > OP_CANCELAR || pnr == PNR_INVALIDO) {
+        fprintf(stderr, "Pedido inválido: %s %s\n", nome_op, texto_pnr);
+        return 1;
+    }
+    int fd = abrirLigacao(endereco, 0);
+    if (fd == -1) {
+        perror("Erro ao ligar ao servidor");
+        return 1;
+    }
+    uint64_t id = ((uint64_t)getpid() << 32) | 1;
+    unsigned char pedido[4 + CORPO_PEDIDO], r[4 + CORPO_RESPOSTA];
+    escrever32(pedido, CORPO_PEDIDO);
+    pedido[4] = op;
+    escrever64(pedido + 5, id);
+    escrever32(pedido + 13, pnr);
+    int erro = escreverTudo(fd, pedido, sizeof(pedido)) == -1 || lerTudo(fd, r, sizeof(r)) == -1
+               || ler32(r) != CORPO_RESPOSTA || r[5] > RESULTADO_EM_ESPERA;
+    close(fd);
+    if (erro) {
+        fprintf(stderr, "Sem resposta válida do servidor.\n");
+        return 1;
+    }
+    time_t prazo = (time_t)ler64(r + 18);
+    printf("%s do PNR %s: %s", NOMES_OPS[op], textoPNR(ler32(r + 14)).texto, NOMES_RESULTADOS[r[5]]);
+    if (op == OP_CONSULTAR && prazo) {
+        struct tm t;
+        char hora[32];
+        strftime(hora, sizeof(hora), "%Y-%m-%d %H:%M:%S", localtime_r(&prazo, &t));
+        printf(" (prazo de pagamento %s)", hora);
+    }
+    printf("\n");
+    return r[5] == RESULTADO_OK ? 0 : 2;
+}
@@ -0,0 +1,47 @@
+// Com --servir ENDERECO (socket Unix ou "tcp:PORTA", pode repetir-se) os
+// clientes externos fazem reservas, consultas, pagamentos e cancelamentos por
+// um protocolo binário. Cada mensagem é um comprimento de 32 bits seguido do
+// corpo, tudo em ordem de rede:
+//   pedido:   op (1) | id do pedido (8) | PNR (4)                       = 13 bytes
+//   resposta: op (1) | código RESULTADO_* (1) | id (8) | PNR (4) | prazo (8) = 22 bytes
+// O PNR vai no seu código de 32 bits (codificarPNR: base 36, até 6
+// caracteres). Numa reserva o PNR do pedido é 0 (o servidor escolhe um novo)
+// ou o PNR a reservar, se ainda não existir; um código fora de
+// [0, LIMITE_PNR) dá RESULTADO_INVALIDO.
+// O cliente pode enviar vários pedidos sem esperar pelas respostas. Uma
+// thread com poll() serve todas as ligações: entrega cada pedido completo ao
+// executor (ao trabalhador da partição do PNR), e os trabalhadores executam-no
+// pelo escalonador e pela tabela de pedidos idempotentes e devolvem a resposta
+// à thread do servidor, que a escreve. Os pedidos em curso do mesmo cliente
+// correm em paralelo e as respostas saem pela ordem em que acabam: o cliente
+// associa-as pelo id e, se um pedido depende de outro, espera pela resposta.
+// Os clientes da rede não entram na lista de espera dos voos (--lugares): com
+// o voo cheio, ou com alguém já à espera, a reserva recebe logo
+// RESULTADO_CHEIO e o cliente decide se volta a tentar.
+// Compilar com o programa: make (ver Makefile)
+#ifndef SERVIDOR_H
+#define SERVIDOR_H
+
+#include <stdatomic.h>
+
+#define MAX_ESCUTAS 4
+
+extern const char *enderecos_servidor[MAX_ESCUTAS]; // --servir
+extern int n_enderecos_servidor;
+extern atomic_int parar_servidor; // o main pede à thread do servidor que termine
+
+// Thread do servidor: serve todas as ligações até parar_servidor e depois
+// espera pelas respostas dos pedidos que ainda estão no executor
+void* servidor_thread(void* arg);
+
+void imprimirMetricasServidor(void);
+
+// --carga ENDERECO N: cliente gerador de carga (N pedidos em lotes); mede
+// pedidos por segundo
+int gerarCarga(const char *endereco, long total);
+
+// --pedir DESTINO OP PNR: envia um só pedido ao servidor e mostra a resposta.
+// Retorna 0 se o resultado foi RESULTADO_OK, 2 se foi outro e 1 em erro.
+int enviarPedido(const char *endereco, const char *nome_op, const char *texto_pnr);
+
+#endif
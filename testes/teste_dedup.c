@@ -0,0 +1,91 @@
+// Teste da tabela de pedidos idempotentes: um pedido novo é executado uma só
+// vez; uma repetição feita enquanto o original corre espera por ele e recebe
+// o seu resultado, e uma feita depois recebe-o logo. Com THREADS_TESTE threads
+// a repetir os mesmos IDs ao mesmo tempo, cada ID tem exatamente um executor e
+// todos os outros veem o resultado dele.
+// Compilar e correr: make test
+#include "projeto.h"
+#include "dedup.h"
+#include "testes.h"
+
+#define THREADS_TESTE 4
+#define IDS_TESTE 2000
+#define PRIMEIRO_ID 1000
+
+typedef struct {
+    uint64_t id;
+    int novo;
+    Resultado res;
+    atomic_int acabou;
+} Repeticao;
+
+static void* repetirPedido(void* arg) {
+    Repeticao *r = arg;
+    r->novo = iniciarPedido(r->id, &r->res);
+    atomic_store(&r->acabou, 1);
+    return NULL;
+}
+
+static atomic_int executados[IDS_TESTE];
+static int executor_do_id[IDS_TESTE];
+static uint32_t visto[THREADS_TESTE][IDS_TESTE];
+
+// Thread t: todos os IDs; quem consegue um ID executa-o com o resultado t
+static void* corridaPedidos(void* arg) {
+    int t = (intptr_t)arg;
+    for (int i = 0; i < IDS_TESTE; i++) {
+        Resultado res;
+        if (iniciarPedido(PRIMEIRO_ID + i, &res)) {
+            atomic_fetch_add(&executados[i], 1);
+            executor_do_id[i] = t;
+            concluirPedido(PRIMEIRO_ID + i, (Resultado){ RESULTADO_OK, (uint32_t)t });
+            visto[t][i] = (uint32_t)t;
+        } else {
+            visto[t][i] = res.codigo == RESULTADO_OK ? res.pnr : PNR_INVALIDO;
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    Resultado res;
+    VERIFICAR(abrirDedup() == 0);
+
+    // Sem ID nunca é repetição
+    VERIFICAR(iniciarPedido(0, &res) == 1);
+    VERIFICAR(iniciarPedido(0, &res) == 1);
+
+    // A repetição espera pelo original e recebe o seu resultado
+    VERIFICAR(iniciarPedido(7, &res) == 1);
+    Repeticao r = { .id = 7 };
+    pthread_t t;
+    pthread_create(&t, NULL, repetirPedido, &r);
+    usleep(100000);
+    VERIFICAR(!atomic_load(&r.acabou));
+    concluirPedido(7, (Resultado){ RESULTADO_OK, 42 });
+    pthread_join(t, NULL);
+    VERIFICAR(r.novo == 0 && r.res.codigo == RESULTADO_OK && r.res.pnr == 42);
+
+    // Depois de concluído responde-se logo da tabela, também com um resultado de falha
+    VERIFICAR(iniciarPedido(7, &res) == 0 && res.codigo == RESULTADO_OK && res.pnr == 42);
+    VERIFICAR(iniciarPedido(8, &res) == 1);
+    concluirPedido(8, (Resultado){ RESULTADO_CHEIO, PNR_INVALIDO });
+    VERIFICAR(iniciarPedido(8, &res) == 0 && res.codigo == RESULTADO_CHEIO);
+
+    pthread_t corrida[THREADS_TESTE];
+    for (int i = 0; i < THREADS_TESTE; i++)
+        pthread_create(&corrida[i], NULL, corridaPedidos, (void*)(intptr_t)i);
+    for (int i = 0; i < THREADS_TESTE; i++)
+        pthread_join(corrida[i], NULL);
+    int executados_uma_vez = 0, respostas_certas = 0;
+    for (int i = 0; i < IDS_TESTE; i++) {
+        executados_uma_vez += atomic_load(&executados[i]) == 1;
+        for (int k = 0; k < THREADS_TESTE; k++)
+            respostas_certas += visto[k][i] == (uint32_t)executor_do_id[i];
+    }
+    printf("Dedup: %d de %d ID(s) executados uma vez, %d de %d resposta(s) iguais às do executor\n",
+           executados_uma_vez, IDS_TESTE, respostas_certas, IDS_TESTE * THREADS_TESTE);
+    VERIFICAR(executados_uma_vez == IDS_TESTE);
+    VERIFICAR(respostas_certas == IDS_TESTE * THREADS_TESTE);
+    return resultadoTeste("Dedup");
+}
@@ -0,0 +1,76 @@
+// Teste do escalonador: com uma só vaga, ocupada enquanto as operações entram
+// em espera, verifica que os pagamentos passam por ordem de prazo à frente
+// das classes que chegaram antes e que uma consulta que esperou
+// 3 * ENVELHECIMENTO_MS passa à frente de todas. Sai com 0 se as concessões
+// seguiram a ordem esperada.
+// Compilar e correr: make test
+#include "projeto.h"
+#include "escalonador.h"
+
+#define MAX_OPERACOES_TESTE 8
+
+typedef struct {
+    int classe;
+    int64_t chave;
+    int rotulo;
+} OperacaoTeste;
+
+static int concessoes_teste[MAX_OPERACOES_TESTE];
+static atomic_int n_concessoes_teste;
+
+static void* operacaoTeste(void* arg) {
+    OperacaoTeste *o = arg;
+    entrarEscalonador(o->classe, o->chave);
+    concessoes_teste[atomic_fetch_add(&n_concessoes_teste, 1)] = o->rotulo;
+    sairEscalonador();
+    return NULL;
+}
+
+// Põe as n operações em espera pela ordem dada (a primeira fica sozinha
+// espera_ms), larga a vaga e compara a ordem das concessões com a esperada
+static int ordemEscalonador(const char *nome, OperacaoTeste *ops, int n, int espera_ms, const int *esperada) {
+    pthread_t t[MAX_OPERACOES_TESTE];
+    atomic_store(&n_concessoes_teste, 0);
+    entrarEscalonador(CLASSE_PAGAMENTO, 0);
+    for (int i = 0; i < n; i++) {
+        pthread_create(&t[i], NULL, operacaoTeste, &ops[i]);
+        while (operacoesEmEspera() < i + 1)
+            usleep(1000);
+        if (i == 0 && espera_ms > 0)
+            usleep(espera_ms * 1000);
+    }
+    sairEscalonador();
+    for (int i = 0; i < n; i++)
+        pthread_join(t[i], NULL);
+    int ok = memcmp(concessoes_teste, esperada, n * sizeof(int)) == 0;
+    printf("%s: concessões", nome);
+    for (int i = 0; i < n; i++)
+        printf(" %d", concessoes_teste[i]);
+    printf(" (%s)\n", ok ? "ok" : "FALHOU");
+    return ok;
+}
+
+int main(void) {
+    vagas_escalonador = 1;
+    int64_t agora = relogioAgoraMs();
+    OperacaoTeste prazos[] = {
+        { CLASSE_CONSULTA, agora, 0 }, { CLASSE_RESERVA, agora, 1 },
+        { CLASSE_PAGAMENTO, agora + 50000, 2 }, { CLASSE_PAGAMENTO, agora + 10000, 3 },
+        { CLASSE_CANCELAMENTO, agora, 4 }, { CLASSE_PAGAMENTO, agora + 30000, 5 },
+    };
+    static const int ordem_prazos[] = { 3, 5, 2, 4, 1, 0 };
+    OperacaoTeste envelhecida[] = {
+        { CLASSE_CONSULTA, agora, 0 }, { CLASSE_PAGAMENTO, agora + 10000, 1 },
+        { CLASSE_CANCELAMENTO, agora, 2 }, { CLASSE_PAGAMENTO, agora + 5000, 3 },
+    };
+    static const int ordem_envelhecida[] = { 0, 3, 1, 2 };
+
+    int ok = ordemEscalonador("Prazos", prazos, 6, 0, ordem_prazos);
+    long antes = promocoesEscalonador();
+    ok &= ordemEscalonador("Envelhecimento", envelhecida, 4, 3 * ENVELHECIMENTO_MS + 50, ordem_envelhecida);
+    if (promocoesEscalonador() == antes) {
+        printf("Envelhecimento: a consulta não foi promovida (FALHOU)\n");
+        ok = 0;
+    }
+    return ok ? 0 : 1;
+}
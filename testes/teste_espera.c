@@ -0,0 +1,79 @@
+// Teste da lista de espera: num voo de 2 lugares cheio, dois clientes entram
+// na lista e uma reserva nova não lhes passa à frente; cada cancelamento
+// entrega o lugar libertado ao cliente seguinte, pela ordem de chegada, e
+// o voo continua com 2 reservas. Enquanto o cliente espera, uma repetição do
+// seu pedido recebe RESULTADO_EM_ESPERA e, depois da entrega, o PNR que lhe
+// coube. A drenagem das listas espera pelos clientes.
+// Compilar e correr: make test
+#include "projeto.h"
+#include "dedup.h"
+#include "testes.h"
+
+#define LUGARES_TESTE 2
+
+// Espera (no máximo 2 s) que a lista do voo p tenha n clientes
+static int esperarProfundidade(int p, int n) {
+    for (int i = 0; i < 200 && clientesEmEspera(p) != n; i++)
+        usleep(10000);
+    return clientesEmEspera(p) == n;
+}
+
+// Resultado do pedido id na tabela, esperando (no máximo 2 s) que deixe de
+// estar em espera se final
+static Resultado resultadoPedido(uint64_t id, int final) {
+    Resultado res = { -1, PNR_INVALIDO };
+    for (int i = 0; i < 200; i++) {
+        if (iniciarPedido(id, &res) != 0) {
+            res.codigo = -1; // não estava na tabela
+            break;
+        }
+        if (!final || res.codigo != RESULTADO_EM_ESPERA)
+            break;
+        usleep(10000);
+    }
+    return res;
+}
+
+int main(void) {
+    time_t prazo;
+    Resultado res;
+    n_particoes = 1;
+    lugares_por_voo = LUGARES_TESTE;
+    semearGeradores(1);
+    iniciarTrincos();
+    VERIFICAR(abrirArmazem() == 0);
+    VERIFICAR(abrirDedup() == 0);
+    abrirCacheConsultas();
+
+    Resultado a = executarPedido(OP_RESERVAR, 1, 0, &prazo);
+    Resultado b = executarPedido(OP_RESERVAR, 2, 0, &prazo);
+    VERIFICAR(a.codigo == RESULTADO_OK && b.codigo == RESULTADO_OK);
+    VERIFICAR(executarPedido(OP_RESERVAR, 3, 0, &prazo).codigo == RESULTADO_CHEIO);
+
+    // Os pedidos 10 e 11 entram na lista, por esta ordem
+    VERIFICAR(iniciarPedido(10, &res) == 1);
+    esperarLugar(0, 10);
+    VERIFICAR(esperarProfundidade(0, 1));
+    VERIFICAR(iniciarPedido(11, &res) == 1);
+    esperarLugar(0, 11);
+    VERIFICAR(esperarProfundidade(0, 2));
+    VERIFICAR(resultadoPedido(10, 0).codigo == RESULTADO_EM_ESPERA);
+    VERIFICAR(executarPedido(OP_RESERVAR, 4, 0, &prazo).codigo == RESULTADO_CHEIO);
+
+    VERIFICAR(executarPedido(OP_CANCELAR, 5, a.pnr, &prazo).codigo == RESULTADO_OK);
+    VERIFICAR(clientesEmEspera(0) == 1);
+    VERIFICAR(atomic_load(&meuPNR[0]->n_reservas) == LUGARES_TESTE);
+    Resultado primeiro = resultadoPedido(10, 1);
+    VERIFICAR(primeiro.codigo == RESULTADO_OK && primeiro.pnr != PNR_INVALIDO);
+    VERIFICAR(resultadoPedido(11, 0).codigo == RESULTADO_EM_ESPERA);
+
+    VERIFICAR(executarPedido(OP_CANCELAR, 6, b.pnr, &prazo).codigo == RESULTADO_OK);
+    VERIFICAR(clientesEmEspera(0) == 0);
+    VERIFICAR(atomic_load(&meuPNR[0]->n_reservas) == LUGARES_TESTE);
+    Resultado segundo = resultadoPedido(11, 1);
+    VERIFICAR(segundo.codigo == RESULTADO_OK && segundo.pnr != PNR_INVALIDO && segundo.pnr != primeiro.pnr);
+
+    encerrarListasEspera();
+    fecharArmazem();
+    return resultadoTeste("Lista de espera");
+}
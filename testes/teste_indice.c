@@ -0,0 +1,103 @@
+// Teste do índice por prazo: THREADS_TESTE threads inserem ao mesmo tempo
+// chaves distintas e depois, com um leitor a percorrer o índice sem parar,
+// retiram metade das suas e inserem outras tantas novas. No fim o índice tem
+// de estar por ordem de (prazo, pnr), com todas as chaves que ficaram e
+// nenhuma das retiradas.
+// Compilar e correr: make test
+#include "projeto.h"
+#include "indice.h"
+#include "testes.h"
+
+#define THREADS_TESTE 4
+#define CHAVES_POR_THREAD 20000
+
+typedef struct {
+    int64_t prazo;
+    uint32_t pnr;
+    long vistas, fora_de_ordem, retiradas;
+} Percurso;
+
+static atomic_int trocas_feitas = 0;
+
+// A chave k da thread t é (k, t * CHAVES_POR_THREAD + k); as novas da
+// segunda fase têm prazo CHAVES_POR_THREAD + k
+static uint32_t pnrTeste(int t, int k) {
+    return (uint32_t)(t * CHAVES_POR_THREAD + k);
+}
+
+static void* inserirChaves(void* arg) {
+    int t = (intptr_t)arg;
+    for (int k = 0; k < CHAVES_POR_THREAD; k++)
+        indiceInserir(k, pnrTeste(t, k), 0);
+    return NULL;
+}
+
+// Retira as chaves pares da thread e insere as novas
+static void* trocarChaves(void* arg) {
+    int t = (intptr_t)arg;
+    for (int k = 0; k < CHAVES_POR_THREAD; k++) {
+        if (k % 2 == 0)
+            indiceRemover(k, pnrTeste(t, k));
+        indiceInserir(CHAVES_POR_THREAD + k, pnrTeste(t, k), 0);
+    }
+    atomic_fetch_add(&trocas_feitas, 1);
+    return NULL;
+}
+
+static void verChave(int64_t prazo, uint32_t pnr, int pago, void *ctx) {
+    (void)pago;
+    Percurso *p = ctx;
+    if (p->vistas > 0 && (prazo < p->prazo || (prazo == p->prazo && pnr <= p->pnr)))
+        p->fora_de_ordem++;
+    if (prazo < CHAVES_POR_THREAD && prazo % 2 == 0)
+        p->retiradas++;
+    p->prazo = prazo;
+    p->pnr = pnr;
+    p->vistas++;
+}
+
+// Percorre o índice enquanto as trocas decorrem (a ordem tem de se manter)
+static void* lerIndice(void* arg) {
+    long *fora_de_ordem = arg;
+    while (atomic_load(&trocas_feitas) < THREADS_TESTE) {
+        Percurso p = { 0 };
+        indiceIntervalo(INT64_MIN, INT64_MAX, verChave, &p);
+        *fora_de_ordem += p.fora_de_ordem;
+    }
+    return NULL;
+}
+
+int main(void) {
+    pthread_t t[THREADS_TESTE], leitor;
+    semearGeradores(1);
+    abrirIndice();
+    VERIFICAR(indice_ativo);
+
+    for (int i = 0; i < THREADS_TESTE; i++)
+        pthread_create(&t[i], NULL, inserirChaves, (void*)(intptr_t)i);
+    for (int i = 0; i < THREADS_TESTE; i++)
+        pthread_join(t[i], NULL);
+    Percurso p = { 0 };
+    VERIFICAR(indiceIntervalo(INT64_MIN, INT64_MAX, verChave, &p) == THREADS_TESTE * CHAVES_POR_THREAD);
+    VERIFICAR(p.fora_de_ordem == 0);
+
+    long fora_de_ordem = 0;
+    pthread_create(&leitor, NULL, lerIndice, &fora_de_ordem);
+    for (int i = 0; i < THREADS_TESTE; i++)
+        pthread_create(&t[i], NULL, trocarChaves, (void*)(intptr_t)i);
+    for (int i = 0; i < THREADS_TESTE; i++)
+        pthread_join(t[i], NULL);
+    pthread_join(leitor, NULL);
+    VERIFICAR(fora_de_ordem == 0);
+
+    p = (Percurso){ 0 };
+    int n = indiceIntervalo(INT64_MIN, INT64_MAX, verChave, &p);
+    printf("Índice: %d chave(s) no fim\n", n);
+    VERIFICAR(n == THREADS_TESTE * (CHAVES_POR_THREAD / 2 + CHAVES_POR_THREAD));
+    VERIFICAR(p.fora_de_ordem == 0);
+    VERIFICAR(p.retiradas == 0);
+    VERIFICAR(indiceIntervalo(0, 0, NULL, NULL) == 0);  // a chave 0 é par: saiu em todas as threads
+    VERIFICAR(indiceIntervalo(1, 1, NULL, NULL) == THREADS_TESTE);
+    fecharIndice();
+    return resultadoTeste("Índice");
+}
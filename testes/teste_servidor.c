@@ -0,0 +1,125 @@
+// Teste do servidor de pedidos: arranca o servidor num socket Unix e, pelo
+// protocolo da rede, reserva, consulta, paga e cancela um PNR, repete um
+// pagamento com o mesmo ID (recebe o resultado original) e envia uma janela
+// de reservas sem esperar pelas respostas, que voltam todas, cada uma com o
+// seu ID.
+// Compilar e correr: make test
+#include "projeto.h"
+#include "executor.h"
+#include "dedup.h"
+#include "servidor.h"
+#include "testes.h"
+
+#define CORPO_PEDIDO 13
+#define CORPO_RESPOSTA 22
+#define JANELA_TESTE 64
+
+typedef struct {
+    int op, codigo;
+    uint64_t id;
+    uint32_t pnr;
+    int64_t prazo;
+} Resposta;
+
+static void escrever32(unsigned char *b, uint32_t v) {
+    v = htonl(v);
+    memcpy(b, &v, 4);
+}
+
+static uint32_t ler32(const unsigned char *b) {
+    uint32_t v;
+    memcpy(&v, b, 4);
+    return ntohl(v);
+}
+
+static int enviar(int fd, int op, uint64_t id, uint32_t pnr) {
+    unsigned char p[4 + CORPO_PEDIDO];
+    escrever32(p, CORPO_PEDIDO);
+    p[4] = op;
+    escrever32(p + 5, id >> 32);
+    escrever32(p + 9, (uint32_t)id);
+    escrever32(p + 13, pnr);
+    return escreverTudo(fd, p, sizeof(p));
+}
+
+static int receber(int fd, Resposta *r) {
+    unsigned char b[4 + CORPO_RESPOSTA];
+    if (lerTudo(fd, b, sizeof(b)) == -1 || ler32(b) != CORPO_RESPOSTA)
+        return -1;
+    r->op = b[4];
+    r->codigo = b[5];
+    r->id = (uint64_t)ler32(b + 6) << 32 | ler32(b + 10);
+    r->pnr = ler32(b + 14);
+    r->prazo = (int64_t)((uint64_t)ler32(b + 18) << 32 | ler32(b + 22));
+    return 0;
+}
+
+// Um pedido e a sua resposta
+static Resposta pedir(int fd, int op, uint64_t id, uint32_t pnr) {
+    Resposta r = { .codigo = -1 };
+    if (enviar(fd, op, id, pnr) == -1 || receber(fd, &r) == -1)
+        r.codigo = -1;
+    return r;
+}
+
+int main(void) {
+    char endereco[64];
+    snprintf(endereco, sizeof(endereco), "/tmp/teste_servidor.%d.sock", (int)getpid());
+    n_particoes = 2;
+    semearGeradores(1);
+    iniciarTrincos();
+    VERIFICAR(abrirArmazem() == 0);
+    VERIFICAR(abrirDedup() == 0);
+    abrirCacheConsultas();
+    executor = executorCriar(2, 0, 0);
+    VERIFICAR(executor != NULL);
+
+    enderecos_servidor[0] = endereco;
+    n_enderecos_servidor = 1;
+    pthread_t servidor;
+    pthread_create(&servidor, NULL, servidor_thread, NULL);
+    int fd = -1;
+    for (int i = 0; i < 200 && (fd = abrirLigacao(endereco, 0)) == -1; i++)
+        usleep(10000);
+    VERIFICAR(fd != -1);
+
+    if (fd != -1) {
+        uint32_t pnr = codificarPNR("TESTE1");
+        Resposta r = pedir(fd, OP_RESERVAR, 1, pnr);
+        VERIFICAR(r.op == OP_RESERVAR && r.id == 1 && r.codigo == RESULTADO_OK && r.pnr == pnr);
+        VERIFICAR(pedir(fd, OP_RESERVAR, 2, pnr).codigo == RESULTADO_INVALIDO);
+        r = pedir(fd, OP_CONSULTAR, 3, pnr);
+        VERIFICAR(r.codigo == RESULTADO_OK && r.prazo > 0);
+        VERIFICAR(pedir(fd, OP_PAGAR, 4, pnr).codigo == RESULTADO_OK);
+        r = pedir(fd, OP_PAGAR, 4, pnr);
+        VERIFICAR(r.codigo == RESULTADO_OK && r.pnr == pnr);
+        VERIFICAR(pedir(fd, OP_PAGAR, 5, pnr).codigo == RESULTADO_JA_PAGO);
+        VERIFICAR(pedir(fd, OP_CONSULTAR, 6, pnr).codigo == RESULTADO_JA_PAGO);
+        VERIFICAR(pedir(fd, OP_CANCELAR, 7, pnr).codigo == RESULTADO_OK);
+        VERIFICAR(pedir(fd, OP_CONSULTAR, 8, pnr).codigo == RESULTADO_INEXISTENTE);
+        VERIFICAR(pedir(fd, 9, 9, pnr).codigo == RESULTADO_INVALIDO);
+
+        // Janela de pedidos sem esperar: as respostas podem vir por outra ordem
+        int respondidos[JANELA_TESTE] = { 0 };
+        for (int i = 0; i < JANELA_TESTE; i++)
+            VERIFICAR(enviar(fd, OP_RESERVAR, 100 + i, 0) == 0);
+        int certas = 0;
+        for (int i = 0; i < JANELA_TESTE; i++) {
+            if (receber(fd, &r) == -1)
+                break;
+            if (r.id >= 100 && r.id < 100 + JANELA_TESTE && !respondidos[r.id - 100]++ &&
+                r.codigo == RESULTADO_OK && r.pnr != 0)
+                certas++;
+        }
+        printf("Servidor: %d de %d reserva(s) da janela respondidas\n", certas, JANELA_TESTE);
+        VERIFICAR(certas == JANELA_TESTE);
+        close(fd);
+    }
+
+    atomic_store(&parar_servidor, 1);
+    pthread_join(servidor, NULL);
+    executorParar(executor);
+    executor = NULL;
+    fecharArmazem();
+    return resultadoTeste("Servidor");
+}
@@ -0,0 +1,24 @@
+// Verificações dos testes (make test): cada falha é impressa com o sítio e
+// conta para o código de saída do programa, que é 0 só sem falhas.
+#ifndef TESTES_H
+#define TESTES_H
+
+#include <stdio.h>
+
+static int falhas_teste = 0;
+
+#define VERIFICAR(condicao) \
+    do { \
+        if (!(condicao)) { \
+            printf("%s:%d: FALHOU: %s\n", __FILE__, __LINE__, #condicao); \
+            falhas_teste++; \
+        } \
+    } while (0)
+
+// Fim de main: resumo e código de saída
+static inline int resultadoTeste(const char *nome) {
+    printf("%s: %s\n", nome, falhas_teste ? "FALHOU" : "ok");
+    return falhas_teste ? 1 : 0;
+}
+
+#endif
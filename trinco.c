@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "trinco.h"
+
+int trincos_justos = 0;
+static atomic_int pedido_perfil = 0; // SIGUSR1 pede a impressão do perfil
+
+static int64_t agora_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static long futex_privado(atomic_uint *p, int op, unsigned valor) {
+    return syscall(SYS_futex, p, op, valor, NULL, NULL, 0);
+}
+
+// Soma a um contador que só o dono do trinco escreve
+static void acumular(atomic_llong *c, int64_t v) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+// Ajusta as voltas do trinco: média móvel das que bastaram, ou recuo se não bastaram
+static void ajustar_giro(Trinco *t, int voltas, int bastaram) {
+    int g = atomic_load_explicit(&t->giro, memory_order_relaxed);
+    g += bastaram ? (voltas - g) / 8 : -g / 8;
+    if (g < 1) g = 1;
+    if (g > GIRO_MAXIMO) g = GIRO_MAXIMO;
+    atomic_store_explicit(&t->giro, g, memory_order_relaxed);
+}
+
+static int limite_giro(Trinco *t) {
+    int limite = 2 * atomic_load_explicit(&t->giro, memory_order_relaxed) + 16;
+    return limite > GIRO_MAXIMO ? GIRO_MAXIMO : limite;
+}
+
+void trincoAdquirido(Trinco *t, int64_t inicio_espera, const char *funcao, int linha) {
+    int64_t agora = agora_ns();
+    acumular(&t->aquisicoes, 1);
+    if (inicio_espera) {
+        acumular(&t->contendidas, 1);
+        acumular(&t->espera_ns, agora - inicio_espera);
+    }
+    t->inicio_posse = agora;
+    t->funcao = funcao;
+    t->linha = linha;
+}
+
+void trincoALargar(Trinco *t) {
+    int64_t posse = agora_ns() - t->inicio_posse;
+    acumular(&t->posse_ns, posse);
+    if (posse > atomic_load_explicit(&t->posse_max_ns, memory_order_relaxed)) {
+        atomic_store_explicit(&t->posse_max_ns, posse, memory_order_relaxed);
+        atomic_store_explicit(&t->funcao_max, t->funcao, memory_order_relaxed);
+        atomic_store_explicit(&t->linha_max, t->linha, memory_order_relaxed);
+    }
+}
+
+// Modo normal: mutex de três estados (0/1/2) sobre um futex, com giro antes de dormir
+static int64_t bloquear_giro(Trinco *t) {
+    unsigned c = 0;
+    if (atomic_compare_exchange_strong(&t->estado, &c, 1))
+        return 0;
+    int64_t inicio = agora_ns();
+    int limite = limite_giro(t);
+    for (int voltas = 1; voltas <= limite; voltas++) {
+        PAUSA_CPU();
+        c = 0;
+        if (atomic_load_explicit(&t->estado, memory_order_relaxed) == 0 &&
+            atomic_compare_exchange_weak(&t->estado, &c, 1)) {
+            ajustar_giro(t, voltas, 1);
+            return inicio;
+        }
+    }
+    ajustar_giro(t, limite, 0);
+    while (atomic_exchange(&t->estado, 2) != 0)
+        futex_privado(&t->estado, FUTEX_WAIT_PRIVATE, 2);
+    return inicio;
+}
+
+static void desbloquear_giro(Trinco *t) {
+    if (atomic_fetch_sub(&t->estado, 1) != 1) {
+        atomic_store(&t->estado, 0);
+        futex_privado(&t->estado, FUTEX_WAKE_PRIVATE, 1);
+    }
+}
+
+// Modo justo: fila MCS; cada thread espera no seu nó até o anterior lhe passar a vez
+static int64_t bloquear_mcs(Trinco *t, NoMCS *no) {
+    atomic_store_explicit(&no->prox, NULL, memory_order_relaxed);
+    atomic_store_explicit(&no->vez, 0, memory_order_relaxed);
+    NoMCS *anterior = atomic_exchange(&t->cauda, no);
+    if (anterior == NULL)
+        return 0;
+    int64_t inicio = agora_ns();
+    atomic_store(&anterior->prox, no);
+    int limite = limite_giro(t), voltas = 0;
+    while (atomic_load(&no->vez) != 1) {
+        if (++voltas <= limite) {
+            PAUSA_CPU();
+            continue;
+        }
+        unsigned v = 0;
+        if (atomic_compare_exchange_strong(&no->vez, &v, 2) || v == 2)
+            futex_privado(&no->vez, FUTEX_WAIT_PRIVATE, 2);
+    }
+    ajustar_giro(t, voltas, voltas <= limite);
+    return inicio;
+}
+
+static void desbloquear_mcs(Trinco *t, NoMCS *no) {
+    NoMCS *seguinte = atomic_load(&no->prox);
+    if (seguinte == NULL) {
+        NoMCS *eu = no;
+        if (atomic_compare_exchange_strong(&t->cauda, &eu, NULL))
+            return;
+        while ((seguinte = atomic_load(&no->prox)) == NULL) // está a ligar-se
+            PAUSA_CPU();
+    }
+    if (atomic_exchange(&seguinte->vez, 1) == 2)
+        futex_privado(&seguinte->vez, FUTEX_WAKE_PRIVATE, 1);
+}
+
+void trincoBloquear(Trinco *t, NoMCS *no, const char *funcao, int linha) {
+    int64_t inicio_espera = trincos_justos ? bloquear_mcs(t, no) : bloquear_giro(t);
+    trincoAdquirido(t, inicio_espera, funcao, linha);
+}
+
+void trincoDesbloquear(Trinco *t, NoMCS *no) {
+    trincoALargar(t);
+    if (trincos_justos)
+        desbloquear_mcs(t, no);
+    else
+        desbloquear_giro(t);
+}
+
+void imprimirPerfilTrinco(const char *nome, Trinco *t) {
+    long long n = atomic_load_explicit(&t->aquisicoes, memory_order_relaxed);
+    long long cont = atomic_load_explicit(&t->contendidas, memory_order_relaxed);
+    long long espera = atomic_load_explicit(&t->espera_ns, memory_order_relaxed);
+    long long posse = atomic_load_explicit(&t->posse_ns, memory_order_relaxed);
+    const char *funcao = atomic_load_explicit(&t->funcao_max, memory_order_relaxed);
+    printf("  %s: %lld aquisições, %lld contendidas (%.1f%%) | espera %.3f ms"
+           " (média %lld ns) | posse %.3f ms (média %lld ns) | posse máx. %.1f us em %s:%d"
+           " | giro %d\n",
+           nome, n, cont, n ? 100.0 * cont / n : 0.0, espera / 1e6, cont ? espera / cont : 0,
+           posse / 1e6, n ? posse / n : 0,
+           atomic_load_explicit(&t->posse_max_ns, memory_order_relaxed) / 1e3,
+           funcao ? funcao : "-", atomic_load_explicit(&t->linha_max, memory_order_relaxed),
+           atomic_load_explicit(&t->giro, memory_order_relaxed));
+}
+
+void trincoPedirPerfil(int sinal) {
+    (void)sinal;
+    atomic_store(&pedido_perfil, 1);
+}
+
+int trincoPerfilPedido(void) {
+    return atomic_exchange(&pedido_perfil, 0);
+}
@@ -0,0 +1,78 @@
+// Trinco híbrido com perfil de contenção, partilhado por Projeto.c e main.c.
+// As secções críticas duram poucas centenas de nanossegundos, por isso quem
+// encontra o trinco ocupado gira um pouco (PAUSA_CPU) antes de ir dormir no
+// futex. O número de voltas adapta-se a cada trinco: aproxima-se das voltas
+// que bastaram quando girar resultou e encolhe quando não resultou.
+// Com trincos_justos os pedidos entram numa fila MCS: cada thread gira (e
+// depois dorme) no seu próprio nó e o trinco passa ao seguinte por ordem de
+// chegada, sem ultrapassagens, o que estabiliza a latência sob contenção forte.
+// Cada trinco conta aquisições, aquisições contendidas, tempo total de espera e
+// de posse e a posse mais longa com o sítio do código que a fez; só quem tem o
+// trinco escreve estes campos.
+// Compilar com o programa: make (ver Makefile)
+#ifndef TRINCO_H
+#define TRINCO_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define GIRO_INICIAL 100
+#define GIRO_MAXIMO 4000
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PAUSA_CPU() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define PAUSA_CPU() __asm__ __volatile__("yield")
+#else
+#define PAUSA_CPU() ((void)0)
+#endif
+
+typedef struct NoMCS {
+    _Atomic(struct NoMCS*) prox;
+    atomic_uint vez;            // 0 à espera, 1 é a sua vez, 2 a dormir no futex
+} NoMCS;
+
+typedef struct {
+    atomic_uint estado;         // 0 livre, 1 ocupado, 2 ocupado com threads a dormir
+    atomic_int giro;            // voltas a dar antes de dormir (adaptativo)
+    _Atomic(NoMCS*) cauda;      // fila do modo justo
+    // Perfil (escrito só por quem tem o trinco, lido a qualquer momento)
+    atomic_llong aquisicoes;
+    atomic_llong contendidas;
+    atomic_llong espera_ns;
+    atomic_llong posse_ns;
+    atomic_llong posse_max_ns;
+    _Atomic(const char*) funcao_max;
+    atomic_int linha_max;
+    int64_t inicio_posse;       // da posse atual
+    const char *funcao;
+    int linha;
+} Trinco;
+
+// Inicializador de um trinco estático
+#define TRINCO_INICIAL { .giro = GIRO_INICIAL }
+
+// Modo justo (fila MCS) para todos os trincos; só se muda antes de os usar
+extern int trincos_justos;
+
+// Bloqueia t em nome de funcao:linha (para o perfil). no é o nó MCS da thread
+// para este trinco; só é usado no modo justo (pode ser NULL fora dele).
+void trincoBloquear(Trinco *t, NoMCS *no, const char *funcao, int linha);
+void trincoDesbloquear(Trinco *t, NoMCS *no);
+
+// Só o perfil, para quem protege a secção com outro mecanismo (ex.: um mutex
+// partilhado entre processos). trincoAdquirido chama-se já com a secção
+// bloqueada (inicio_espera é 0 se não houve contenção) e trincoALargar antes
+// de a largar.
+void trincoAdquirido(Trinco *t, int64_t inicio_espera, const char *funcao, int linha);
+void trincoALargar(Trinco *t);
+
+// Imprime uma linha com o perfil de t, identificado por nome
+void imprimirPerfilTrinco(const char *nome, Trinco *t);
+
+// Tratador de SIGUSR1: só regista o pedido do perfil. trincoPerfilPedido
+// devolve 1 (uma vez por pedido) quando o programa o deve imprimir.
+void trincoPedirPerfil(int sinal);
+int trincoPerfilPedido(void);
+
+#endif